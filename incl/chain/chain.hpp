@@ -4,6 +4,7 @@
 #include <nlohmann/json.hpp>
 
 #include "core/block_header.hpp"
+#include "core/interface/proof_aggregator.hpp"
 #include "store/interface/i_mempool.hpp"
 #include "store/interface/i_chainstate.hpp"
 #include "store/interface/i_blockstore.hpp"
@@ -24,8 +25,10 @@ private:
     std::shared_ptr<Block> create_genesis();
 
 public:
-    Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store);
-    Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<ICompStore> comp_store, bool is_fork);
+    Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store,
+          std::shared_ptr<ProofAggregator> aggregator);
+    Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<ICompStore> comp_store,
+          std::shared_ptr<ProofAggregator> aggregator, bool is_fork);
 
     std::shared_ptr<BlockHeader> head_header();
     std::vector<std::shared_ptr<BlockHeader>> header_chain_;
@@ -52,6 +55,8 @@ protected:
     std::shared_ptr<IBlockStore> block_store_;
     std::shared_ptr<IMemPool> mem_pool_;
     std::shared_ptr<ICompStore> comp_store_;
+    // verifies headers carrying a block proof
+    std::shared_ptr<ProofAggregator> aggregator_;
 };
 
 #endif
\ No newline at end of file
@@ -19,6 +19,7 @@
 #include "store/interface/i_mempool.hpp"
 #include "store/interface/i_compstore.hpp"
 #include "core/interface/computation.hpp"
+#include "core/interface/proof_aggregator.hpp"
 
 using json = nlohmann::json;
 
@@ -36,6 +37,7 @@ protected:
     std::shared_ptr<IMemPool> mem_pool_;
     std::shared_ptr<ICompStore> comp_store_;
 
+    std::shared_ptr<ProofAggregator> aggregator_;
     std::unique_ptr<Miner> miner_;
 
     std::shared_ptr<Wallet> wallet_;
@@ -46,7 +48,8 @@ public:
 
     ChainManager(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> blockstore,
                  std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store,
-                 std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<Wallet> wallet);
+                 std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<Wallet> wallet,
+                 std::shared_ptr<ProofAggregator> aggregator);
 
     bool add_block(std::shared_ptr<Block> block, bool is_main_and_valid = false);
 
@@ -21,7 +21,7 @@ public:
     uint32_t chain_src_;
     std::shared_ptr<BlockHeader> chain_src_header_;
     Fork(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<ICompStore> comp_store,
-         uint32_t chain_src, std::shared_ptr<BlockHeader> chain_src_header, uint64_t diff);
+         std::shared_ptr<ProofAggregator> aggregator, uint32_t chain_src, std::shared_ptr<BlockHeader> chain_src_header, uint64_t diff);
 
     uint32_t current_fork_height();
     bool append_block(std::shared_ptr<Block> block);
@@ -6,8 +6,10 @@
 #include "core/block.hpp"
 #include "core/block_header.hpp"
 #include "core/transaction.hpp"
+#include "core/interface/proof_aggregator.hpp"
 
 #include "wallet/wallet.hpp"
+#include "util/thread_pool.hpp"
 
 #include <memory>
 #include <atomic>
@@ -17,7 +19,16 @@ class Miner
 public:
     bool have_result_;
     std::shared_ptr<Block> result;
-    Miner(std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store);
+    /**
+     * @brief With an aggregator, the computations of a block are proven together in the header.
+     *
+     * @param prover_workers computations of a block bound and proven concurrently
+     * @param thread_budget threads shared by the concurrent proofs, split among the OpenMP regions of libiop.
+     * 0 uses every hardware thread
+     */
+    Miner(std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store,
+          std::shared_ptr<ProofAggregator> aggregator = nullptr, uint32_t binding_version = BINDING_FULL_HEADER,
+          std::size_t prover_workers = 1, std::size_t thread_budget = 0);
 
     void mine(std::shared_ptr<BlockHeader> prev_header, uint32_t height, uint32_t difficutly, uint64_t reward,
               const std::vector<std::shared_ptr<Transaction>> &tx, const std::vector<std::shared_ptr<Computation>> &comps,
@@ -28,6 +39,11 @@ private:
     std::shared_ptr<std::atomic<bool>> stop_flag_;
     std::shared_ptr<IMemPool> mem_pool_;
     std::shared_ptr<ICompStore> comp_store_;
+    std::shared_ptr<ProofAggregator> aggregator_;
+    // of the blocks mined here
+    uint32_t binding_version_;
+    std::unique_ptr<ThreadPool> prover_pool_;
+    std::size_t thread_budget_;
 };
 
 #endif
\ No newline at end of file
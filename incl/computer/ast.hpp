@@ -1,63 +1,155 @@
 #ifndef DIPLO_AST_HPP
 #define DIPLO_AST_HPP
 
-#include <deque>
+#include <cstdint>
 #include <string>
-#include <memory>
-#include <stack>
+#include <vector>
 
-class ASTLeaf;
+enum class ASTOp : uint8_t
+{
+    Leaf = 0,
+    Add,
+    Sub,
+    Mul,
+    // only emitted by the scheduling pass, single operand in left_
+    Relin,
+    Rescale,
+    // plaintext integer leaf, val_ is the constant. Written #k in expressions
+    Const,
+    // only emitted by the scheduling pass, ciphertext operand in left_ and the constant in val_
+    AddPlain,
+    MulPlain,
+    // x^k with the exponent in val_ and the base in left_. Only in the parsed tree, compile lowers it to products
+    Pow
+};
 
-class ASTNode
+// Token of an expression in postfix order, val_ is the ciphertext index of a Leaf, the value of a Const or
+// the exponent of a Pow
+struct ASTToken
 {
-public:
-    bool is_leaf;
-    int val_;
-    int node_id_;
-    std::shared_ptr<ASTNode> parent_;
-    std::shared_ptr<ASTNode> left_child_;
-    std::shared_ptr<ASTNode> right_child_;
-    std::string op_;
-
-    int depth_;
-    bool counts_for_depth_;
-
-    ASTNode(int id, bool counts_for_depth, std::shared_ptr<ASTNode> parent, std::string op);
-    ASTNode(int id, int val, std::shared_ptr<ASTNode> parent);
-
-    bool insert_child(std::shared_ptr<ASTNode> child);
-    bool can_rotate_left();
-    bool can_rotate_right();
-    bool is_full();
-
-    void notify_child_change(std::shared_ptr<ASTNode> new_child, int old_child_id);
+    ASTOp op_;
+    int32_t val_;
+};
+
+// marks a missing parent/child index
+constexpr uint32_t AST_NONE = UINT32_MAX;
+
+// Nodes live in ASTree::nodes_ and refer to each other by index
+struct ASTNode
+{
+    uint32_t parent_;
+    uint32_t left_child_;
+    uint32_t right_child_;
+    // ciphertext index of a Leaf, value of a Const, exponent of a Pow
+    int32_t val_;
+    int32_t depth_;
+    ASTOp op_;
+
+    // Leaf or Const
+    bool is_leaf() const;
+    bool is_const() const;
+    bool counts_for_depth() const;
+    bool is_full() const;
+};
+
+// One step of the post-order program. Operands are indices of earlier instructions.
+struct ASTInstr
+{
+    ASTOp op_;
+    uint32_t left_;
+    uint32_t right_;
+    int32_t val_;
+    int32_t depth_;
+    // number of ciphertext elements of the result, tracked by the scheduling pass
+    uint32_t degree_;
+};
+
+// Key switching work of a scheduled program, compared with aligning operands one
+// Relinearize + Rescale step at a time at every use
+struct ScheduleReport
+{
+    uint64_t naive_relins;
+    uint64_t naive_rescales;
+    uint64_t relins;
+    uint64_t rescales;
 };
 
 class ASTree
 {
 public:
-    int node_counter_;
-    ASTree(const std::string &expression);
-    ASTree(const std::deque<std::string> &input);
-    std::shared_ptr<ASTNode> root_;
-    std::stack<std::shared_ptr<ASTNode>> node_stack;
+    ASTree(const std::string &expression, bool cse = false);
+    ASTree(const std::vector<ASTToken> &postfix, bool cse = false);
+
+    // single pass Shunting Yard, turns an infix expression into postfix tokens
+    static std::vector<ASTToken> shunt(const std::string &expression);
+
+    std::vector<ASTNode> nodes_;
+    uint32_t root_;
+
+    // Post-order program of the balanced tree, produced once after balancing. The last instruction is
+    // the output. With CSE, structurally identical subtrees share a single instruction.
+    std::vector<ASTInstr> program_;
 
     void bfs_print();
 
-    int get_balance(std::shared_ptr<ASTNode> node);
-    int get_depth(std::shared_ptr<ASTNode> node);
+    ScheduleReport schedule_report_;
 
-    std::shared_ptr<ASTNode> right_rotate(std::shared_ptr<ASTNode> node);
-    std::shared_ptr<ASTNode> left_rotate(std::shared_ptr<ASTNode> node);
+    // multiplicative depth of the whole expression
+    int depth() const;
+
+    /**
+     * @brief Inserts the Relin and Rescale instructions that bring the operands of every instruction to
+     * the same level.
+     *
+     * Alignment is computed once here instead of during evaluation. Products are not relinearized on
+     * their own: they are added together as they are and only a value that actually has to drop a level
+     * while holding more than two elements is relinearized, once. An aligned value is shared by all its
+     * users. Must be called once, before the program is evaluated.
+     *
+     * @param input_degrees number of elements of every input ciphertext, missing entries count as 2
+     */
+    void schedule(const std::vector<uint32_t> &input_degrees);
+
+    int get_depth(uint32_t node);
 
 private:
-    const std::deque<std::string> input_;
+    const std::vector<ASTToken> input_;
+    bool is_scheduled_;
 
     void build_tree();
-    std::deque<std::string> shunt(const std::string &expression);
-    
 
-    std::shared_ptr<ASTNode> reorg_from(std::shared_ptr<ASTNode> node);
+    uint32_t add_node(ASTOp op, int32_t val);
+    void notify_child_change(uint32_t node, uint32_t new_child, uint32_t old_child);
+
+    /**
+     * @brief Rebuilds the parsed tree with the minimum multiplicative depth.
+     *
+     * Maximal chains of * and of +/- are flattened into their operands, with - turned into signs, and
+     * merged again shallowest first. Chains are handled bottom up, so products of sums and sums of
+     * products are balanced at every level. The constants of a chain are folded into one, applied to the
+     * merged ciphertext operands last, and a product by a constant does not add to the depth.
+     */
+    void rebalance();
+    bool same_chain(uint32_t a, uint32_t b) const;
+    // returns the root of the rebuilt chain
+    uint32_t rebuild_chain(uint32_t chain_root, std::vector<int32_t> &height);
+    // folds a constant base, drops ^1 and sets the depth of the power
+    void rebuild_pow(uint32_t node, std::vector<int32_t> &height);
+    // node applying the constant to operand, which must be a ciphertext subtree
+    uint32_t apply_const(ASTOp op, uint32_t operand, int64_t value, std::vector<int32_t> &height);
+
+    // multiplicative depth added by the square-and-multiply lowering of x^exponent
+    static int32_t pow_depth(int32_t exponent);
+
+    /**
+     * @brief Emits program_ from the balanced tree.
+     *
+     * With cse, two subtrees with the same operator and identical operands are emitted once, comparing
+     * the operands of + and * in either order. A power is lowered by square-and-multiply: the repeated
+     * squares of the base are emitted once and the ones of the set exponent bits are multiplied
+     * shallowest first.
+     */
+    void compile(bool cse);
 };
 
 #endif
@@ -0,0 +1,62 @@
+#ifndef DIPLO_AURORA_PARAMS_CACHE_HPP
+#define DIPLO_AURORA_PARAMS_CACHE_HPP
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <tuple>
+
+#include "nlohmann/json.hpp"
+#include "proofsystem/proofsystem_libsnark.h"
+#include "libiop/snark/aurora_snark.hpp"
+
+using json = nlohmann::json;
+
+typedef libiop::binary_hash_digest hash_type;
+
+// Aurora settings shared by the prover and the verifier of computation proofs
+struct AuroraParamSet
+{
+    std::size_t security_parameter;
+    std::size_t RS_extra_dimensions;
+    std::size_t FRI_localization_parameter;
+    libiop::LDT_reducer_soundness_type ldt_reducer_soundness_type;
+    libiop::FRI_soundness_type fri_soundness_type;
+    libiop::field_subset_type domain_type;
+    bool make_zk;
+
+    static AuroraParamSet standard();
+};
+
+/**
+ * @brief Process-wide cache of Aurora parameters.
+ *
+ * Building the parameters computes the evaluation domains and the FRI query plans, which only depend on the
+ * parameter set and the padded constraint system dimensions. Padded dimensions are powers of two, so only a
+ * few distinct entries exist and they are never evicted.
+ */
+class AuroraParamsCache
+{
+public:
+    typedef libiop::aurora_snark_parameters<FieldT, hash_type> Params;
+
+    std::shared_ptr<const Params> get(const AuroraParamSet &set, std::size_t num_constraints, std::size_t num_variables);
+
+    /**
+     * @brief Builds the standard parameters of the given padded sizes ahead of time.
+     *
+     * @param sizes [num_constraints, num_variables] pairs, as in config["proof"]["aurora_warmup"]
+     */
+    void warm_up(const json &sizes);
+
+    static AuroraParamsCache &instance();
+
+private:
+    typedef std::tuple<std::size_t, std::size_t, std::size_t, int, int, int, bool, std::size_t, std::size_t> Key;
+
+    std::mutex mu_;
+    std::map<Key, std::shared_ptr<const Params>> params_;
+};
+
+#endif
@@ -0,0 +1,79 @@
+#ifndef DIPLO_COST_MODEL_HPP
+#define DIPLO_COST_MODEL_HPP
+
+#include <cstdint>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "openfhe.h"
+#include "computer/ast.hpp"
+#include "computer/proof_backend.hpp"
+#include "core/interface/computation.hpp"
+
+using json = nlohmann::json;
+using namespace lbcrypto;
+
+/**
+ * @brief Predicts the cost of proving a scheduled AST program, without evaluating it.
+ *
+ * Every instruction is charged units per ciphertext element it touches, per RNS tower left at its level
+ * and per ring coefficient. The units of every kind of operation, times its weight, predict the
+ * constraints left by the optimizer; padding them gives the sizes the backend works on. Prove time is
+ * linear in padded_constraints * log2(padded_constraints) and verify time in padded_constraints, with
+ * coefficients per backend.
+ *
+ * The weights, the variables per constraint and the backend coefficients come from
+ * config["proof"]["cost_model"]. `bench cost` fits all of them to sample computations and prints that
+ * config; the defaults are only rough.
+ */
+class CostModel
+{
+public:
+    struct BackendTimes
+    {
+        double prove_fixed_s;
+        // per padded constraint and bit of the padded size
+        double prove_s;
+        double verify_fixed_s;
+        // per padded constraint
+        double verify_s;
+    };
+
+    // element, tower and coefficient units by kind of operation, see kinds()
+    typedef std::map<std::string, double> Units;
+
+    CostModel();
+
+    void configure(const json &config);
+    // current coefficients, in the format of configure
+    json config();
+
+    /**
+     * @param program scheduled program, see ASTree::schedule
+     * @param inputs ciphertexts the leaves refer to, only their sizes are read
+     */
+    CostEstimate estimate(const std::vector<ASTInstr> &program, CryptoContext<DCRTPoly> cc, const std::vector<Ciphertext<DCRTPoly>> &inputs);
+
+    // units of every kind of operation of the program, what the weights multiply. Also counts the operations
+    // into counts, if given
+    static Units units(const std::vector<ASTInstr> &program, CryptoContext<DCRTPoly> cc, const std::vector<Ciphertext<DCRTPoly>> &inputs,
+                       CostEstimate *counts = nullptr);
+    // add, mul, plain, relin, rescale and output, the keys of "weights" in the config
+    static const std::vector<std::string> &kinds();
+
+    static json to_json(const CostEstimate &estimate);
+
+    static CostModel &instance();
+
+private:
+    std::mutex mu_;
+    // constraints per unit, by kind of operation
+    std::map<std::string, double> weights_;
+    double variables_per_constraint_;
+    std::map<ProofBackendType, BackendTimes> times_;
+};
+
+#endif
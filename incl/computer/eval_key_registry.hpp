@@ -0,0 +1,85 @@
+#ifndef DIPLO_EVAL_KEY_REGISTRY_HPP
+#define DIPLO_EVAL_KEY_REGISTRY_HPP
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <string>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "openfhe.h"
+
+using json = nlohmann::json;
+using namespace lbcrypto;
+
+/**
+ * @brief Node-wide registry of the EvalMultKeys loaded into OpenFHE.
+ *
+ * Keys are registered by the hash of their serialization, so relays of a computation and blocks containing it
+ * load the keys once. Anyone can submit keys under the tag of someone else's public key, so keys are never
+ * looked up by that tag: computations evaluate with the keys of their entry, and the proof system, which asks
+ * OpenFHE for them by the tag of the ciphertext, finds them under eval_tag_, derived from the hash. Computations
+ * hold the handle returned by acquire, and keys that no live computation holds are cleared from OpenFHE on the
+ * next sweep.
+ */
+class EvalKeyRegistry
+{
+public:
+    struct Entry
+    {
+        // tag of the public key the keys belong to
+        std::string key_tag_;
+        // tag the keys are loaded into OpenFHE under, which the ciphertexts of the computation carry
+        std::string eval_tag_;
+        std::vector<EvalKey<DCRTPoly>> keys_;
+        // serialized keys as received, what computations serialize again
+        std::shared_ptr<const std::string> serialized_;
+        std::vector<unsigned char> digest_;
+        std::size_t bytes_;
+    };
+
+    /**
+     * @brief Loads the serialized keys of a computation, unless they are loaded already.
+     *
+     * @param serialized EvalMultKeys as serialized by SerializeEvalMultKey
+     * @param key_tag tag of the public key of the computation, the keys must belong to it
+     * @return handle keeping the keys loaded while held
+     * @throws std::invalid_argument if the keys belong to another tag
+     */
+    std::shared_ptr<const Entry> acquire(const std::string &serialized, const std::string &key_tag);
+
+    // to be held while OpenFHE looks keys up by tag, its map of keys is only changed under the exclusive lock
+    std::shared_lock<std::shared_mutex> lookup_lock();
+
+    /**
+     * @brief Clears the keys no computation holds.
+     *
+     * @return number of entries evicted
+     */
+    std::size_t sweep();
+
+    json metrics();
+
+    // one 64-bit native integer per coefficient of every RNS tower of every key element
+    static std::size_t key_bytes(const std::vector<EvalKey<DCRTPoly>> &keys);
+
+    static EvalKeyRegistry &instance();
+
+private:
+    std::size_t sweep_locked();
+
+    std::mutex mu_;
+    // guards the global map of OpenFHE, see lookup_lock
+    std::shared_mutex openfhe_mu_;
+    // by digest
+    std::map<std::string, std::shared_ptr<const Entry>> entries_;
+    std::size_t bytes_ = 0;
+    std::size_t loads_ = 0;
+    std::size_t hits_ = 0;
+    std::size_t evictions_ = 0;
+};
+
+#endif
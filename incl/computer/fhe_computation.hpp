@@ -1,6 +1,7 @@
 #ifndef DIPLO_FHE_COMPUTATION_HPP
 #define DIPLO_FHE_COMPUTATION_HPP
 
+#include <memory>
 #include <string>
 #include <vector>
 #include <ctime>
@@ -13,6 +14,8 @@
 #include "key/key-ser.h"
 
 #include "message.pb.h"
+#include "computer/eval_key_registry.hpp"
+#include "util/byte_sink.hpp"
 
 using json = nlohmann::json;
 using namespace lbcrypto;
@@ -25,8 +28,15 @@ public:
     // Ciphertext<DCRTPoly> is already a shared pointer
     std::vector<Ciphertext<DCRTPoly>> ciphertexts_;
     std::time_t timestamp_;
+    // identical subexpressions are evaluated and constrained once, this changes the constraint system
+    // so it is part of the computation
+    bool cse_;
+    // digest of the serialized EvalMultKey as received, empty if none was needed
+    std::vector<unsigned char> evalmult_key_digest_;
+    // keeps the EvalMultKey loaded while the computation lives, null if none was needed
+    std::shared_ptr<const EvalKeyRegistry::Entry> evalmult_key_;
 
-    FHEComputation() = default;
+    FHEComputation() : cse_(false), is_bound_(false) {}
     FHEComputation(const json &computation_json);
 
     CryptoContext<DCRTPoly> GetCryptoContext();
@@ -39,12 +49,33 @@ public:
      */
     void bind_inputs_to_data(const std::vector<unsigned char> &data);
 
+    // gives an evaluated ciphertext back the tag of the public key, the inputs carry the one of the EvalMultKeys
+    // (see EvalKeyRegistry) while evaluating
+    Ciphertext<DCRTPoly> untag(Ciphertext<DCRTPoly> c) const;
+
     std::vector<unsigned char> serialize();
 
+    /**
+     * @brief Writes the same bytes as serialize to the sink, without building them.
+     *
+     * The keys and the ciphertexts are written straight from the buffers they arrived in.
+     */
+    void serialize_to(util::ByteSink &sink) const;
+    std::size_t serialized_size() const;
+
+    // immutable serialized forms of the public key and the unbound ciphertexts, as received. The EvalMultKey
+    // one is kept by evalmult_key_
+    std::shared_ptr<const std::string> public_key_bytes_;
+    std::vector<std::shared_ptr<const std::string>> ciphertext_bytes_;
+
     std::vector<Ciphertext<DCRTPoly>> unbound_ciphertexts_archive_;
     bool is_bound_;
 
     static FHEComputation from_proto(const ProtoComputation &proto);
+
+private:
+    // acquires the EvalMultKeys and tags the inputs with their eval_tag_
+    void load_evalmult_key(const std::string &serialized);
 };
 
 #endif
\ No newline at end of file
@@ -1,12 +1,17 @@
 #ifndef DIPLO_FHE_COMPUTER_HPP
 #define DIPLO_FHE_COMPUTER_HPP
 
+#include <map>
 #include <memory>
 #include <unordered_set>
 #include <atomic>
 
 #include "ast.hpp"
 #include "fhe_computation.hpp"
+#include "r1cs_cache.hpp"
+#include "aurora_params_cache.hpp"
+#include "proof_backend.hpp"
+#include "cost_model.hpp"
 #include "nlohmann/json.hpp"
 #include "proofsystem/proofsystem_libsnark.h"
 
@@ -19,12 +24,22 @@
 
 using json = nlohmann::json;
 
-typedef libiop::binary_hash_digest hash_type;
+// wall time of the mining steps of a computation, in milliseconds
+struct ComputationTimings
+{
+    double bind_ms = 0;
+    // evaluation and constraint generation, done in a single traversal
+    double constraints_ms = 0;
+    // conversion of the constraint system and the proof backend
+    double prove_ms = 0;
+};
 
 class FHEComputer : public Computation
 {
 public:
     std::shared_ptr<FHEComputation> computation_;
+    // filled by bind_to_data, generate_constraints and generate_proof
+    ComputationTimings timings_;
     std::unique_ptr<ASTree> ast_;
     std::unique_ptr<LibsnarkProofSystem> ps_;
 
@@ -39,19 +54,35 @@ public:
     void generate_witness();
 
     std::vector<unsigned char> output() override;
+    // serialized output, evaluated first if needed
+    const std::string &output_bytes();
 
     void bind_to_data(const std::vector<unsigned char> &data) override;
     std::vector<unsigned char> proof() override;
     void generate_proof() override;
     bool verify_proof(const std::vector<unsigned char> &proof) override;
     uint32_t difficulty() override;
-
-    libiop::aurora_snark_argument<FieldT, hash_type> generate_argument();
-
-    bool verify_argument(const libiop::aurora_snark_argument<FieldT, hash_type> &argument);
+    // predicted by CostModel from the scheduled program, made once
+    CostEstimate estimate_cost() override;
+
+    /**
+     * @brief Runs the computation through the proof system and returns its constraint system along with the
+     * unpadded assignment, for arguments over several computations (see FHEProofAggregator).
+     */
+    std::shared_ptr<const R1CSCache::Circuit> prove_circuit(libiop::r1cs_primary_input<FieldT> &primary, libiop::r1cs_auxiliary_input<FieldT> &aux);
+    // same for the verifier, which only assigns the unpadded public input. Null when the claimed output does not
+    // fit the circuit
+    std::shared_ptr<const R1CSCache::Circuit> verify_circuit(libiop::r1cs_primary_input<FieldT> &primary);
+
+    // identifies the constraint system of this computation, see R1CSCache
+    std::vector<unsigned char> shape_key();
+    // where the public variables of ps_ are, set by generate_constraints
+    const PublicOutputLayout &io_layout() const;
 
     // this one includes output and computes it if not yet computed
     std::vector<unsigned char> serialize(bool include_output) override;
+    void serialize_to(util::ByteSink &sink, bool include_output) override;
+    std::size_t serialized_size(bool include_output) override;
 
     // this one does not include output
     std::vector<unsigned char> serialize_for_hash();
@@ -60,25 +91,59 @@ public:
     std::vector<unsigned char> hash_force() override;
 
     void set_stop_flag(std::shared_ptr<std::atomic<bool>> stop_flag) override;
+    std::shared_ptr<std::atomic<bool>> stop_flag() const override;
 
     ProtoComputation to_proto() const override;
 
     static FHEComputer from_proto(const ProtoComputation &proto);
 
+    // adds the timings of a proof to the totals of this process
+    static void record_timings(const ComputationTimings &timings);
+    // proofs generated by this process and the sums of their timings, reported by the metrics RPC
+    static json timing_totals();
+
 private:
-    // NOTE: pass by ref here
-    Ciphertext<DCRTPoly> eval(std::shared_ptr<ASTNode> &node, bool eval_mode);
-    void init_public_input(std::shared_ptr<ASTNode> node);
+    // runs the AST program, either with the CryptoContext or through the proof system
+    Ciphertext<DCRTPoly> eval(bool eval_mode);
+    // evaluates with the CryptoContext, running independent subtrees on the compute pool
+    Ciphertext<DCRTPoly> eval_parallel();
+    Ciphertext<DCRTPoly> apply_op(const ASTInstr &instr, Ciphertext<DCRTPoly> c_left, Ciphertext<DCRTPoly> c_right, bool eval_mode);
+    void init_public_input();
+    // plaintexts of the constants of the program, made once before evaluating
+    void prepare_constants();
+    // runs the scheduling pass of the AST program for the submitted ciphertexts
+    void schedule_program();
+
+    // optimized and padded libiop constraint system of this computation, from the cache or converted from ps_
+    std::shared_ptr<const R1CSCache::Circuit> constraint_system();
+    // assigns only the public input and output, enough to verify against a cached constraint system
+    void assign_public_io();
+    // constraint system for verification, assigning the public variables of ps_ on the way
+    std::shared_ptr<const R1CSCache::Circuit> verifier_circuit();
+
+    std::vector<unsigned char> shape_key_;
+    // where the public variables of ps_ are
+    PublicOutputLayout io_layout_;
 
     std::vector<unsigned char> proof_;
+    // backend proof_ was made with
+    ProofBackendType backend_ = ProofBackendType::Aurora;
+    // shape_key() of the prover for preprocessing backends, empty otherwise
+    std::vector<unsigned char> proof_shape_id_;
 
-    std::unordered_set<int> seen_;
     Ciphertext<DCRTPoly> last_res_;
+    std::map<int32_t, Plaintext> constants_;
+    // serialized last_res_, as received or serialized once; only valid while output_bytes_of_ is last_res_
+    std::shared_ptr<const std::string> output_bytes_;
+    Ciphertext<DCRTPoly> output_bytes_of_;
 
     std::shared_ptr<std::atomic<bool>> stop_flag_;
 
     bool has_hash_;
     std::vector<unsigned char> hash_;
+
+    bool has_cost_ = false;
+    CostEstimate cost_;
 };
 
 #endif
\ No newline at end of file
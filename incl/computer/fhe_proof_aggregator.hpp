@@ -0,0 +1,27 @@
+#ifndef DIPLO_FHE_PROOF_AGGREGATOR_HPP
+#define DIPLO_FHE_PROOF_AGGREGATOR_HPP
+
+#include <memory>
+#include <vector>
+
+#include "core/interface/proof_aggregator.hpp"
+#include "computer/fhe_computer.hpp"
+
+/**
+ * @brief Block proofs for FHE computations.
+ *
+ * The optimized constraint systems of the computations are placed side by side in one system, padded
+ * once and proven with a single Aurora argument, so the commitments, FRI rounds and queries are paid once
+ * per block instead of once per computation.
+ */
+class FHEProofAggregator : public ProofAggregator
+{
+public:
+    std::vector<unsigned char> prove(const std::vector<std::shared_ptr<Computation>> &computations) override;
+    bool verify(const std::vector<std::shared_ptr<Computation>> &computations, const std::vector<unsigned char> &proof) override;
+
+private:
+    static std::shared_ptr<FHEComputer> as_fhe(const std::shared_ptr<Computation> &comp);
+};
+
+#endif
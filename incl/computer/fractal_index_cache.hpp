@@ -0,0 +1,76 @@
+#ifndef DIPLO_FRACTAL_INDEX_CACHE_HPP
+#define DIPLO_FRACTAL_INDEX_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "computer/r1cs_cache.hpp"
+#include "computer/aurora_params_cache.hpp"
+#include "libiop/snark/fractal_snark.hpp"
+
+/**
+ * @brief Process-wide cache of Fractal indexes, by circuit shape.
+ *
+ * Indexing commits to the constraint matrices once per shape, after which verification no longer reads
+ * the constraint system. Verifier indexes are also written to the index directory along with the system
+ * their parameters are derived from, so a restarted node verifies known shapes without generating their
+ * constraints again (see find_verifier). The directory is trusted, it only holds indexes made by this node.
+ * The least recently used shapes are evicted past the capacity.
+ */
+class FractalIndexCache
+{
+public:
+    typedef libiop::fractal_snark_parameters<FieldT, hash_type> Params;
+    typedef libiop::bcs_prover_index<FieldT, hash_type> ProverIndex;
+    typedef libiop::bcs_verifier_index<FieldT, hash_type> VerifierIndex;
+
+    struct Entry
+    {
+        // the indexed system, shared with the parameters
+        std::shared_ptr<const R1CSCache::ConstraintSystem> cs_;
+        std::shared_ptr<const Params> params_;
+        // null when the verifier index was loaded from disk
+        std::shared_ptr<const ProverIndex> prover_index_;
+        std::shared_ptr<const VerifierIndex> verifier_index_;
+    };
+
+    explicit FractalIndexCache(std::size_t capacity);
+
+    // indexes cs on first use of the shape
+    std::shared_ptr<const Entry> for_prover(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs);
+    // loads the verifier index from disk, or indexes cs, on first use of the shape
+    std::shared_ptr<const Entry> for_verifier(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs);
+    // indexed shape from memory or the index directory, null if it was never indexed
+    std::shared_ptr<const Entry> find_verifier(const std::vector<unsigned char> &shape_id);
+
+    // empty keeps indexes in memory only
+    void set_directory(const std::string &dir);
+
+    static FractalIndexCache &instance();
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<const Entry>> Item;
+
+    std::shared_ptr<const Entry> find(const std::string &key);
+    std::shared_ptr<const Entry> insert(const std::string &key, std::shared_ptr<const Entry> entry);
+    std::shared_ptr<const Entry> index(const std::vector<unsigned char> &shape_id, std::shared_ptr<R1CSCache::ConstraintSystem> cs);
+    static std::shared_ptr<const Params> make_params(std::shared_ptr<R1CSCache::ConstraintSystem> cs);
+
+    std::string path(const std::vector<unsigned char> &shape_id, const std::string &ext);
+    std::shared_ptr<const Entry> load(const std::vector<unsigned char> &shape_id);
+    void store(const std::vector<unsigned char> &shape_id, const Entry &entry);
+
+    std::size_t capacity_;
+    std::mutex mu_;
+    std::string dir_;
+    // most recently used first
+    std::list<Item> items_;
+    std::unordered_map<std::string, std::list<Item>::iterator> lookup_;
+};
+
+#endif
@@ -0,0 +1,97 @@
+#ifndef DIPLO_PROOF_BACKEND_HPP
+#define DIPLO_PROOF_BACKEND_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "nlohmann/json.hpp"
+#include "computer/r1cs_cache.hpp"
+#include "computer/aurora_params_cache.hpp"
+
+using json = nlohmann::json;
+
+// stored with every proof (ProtoComputation.proof_backend), so the verifier does not depend on its own config
+enum class ProofBackendType : uint32_t
+{
+    Aurora = 0,
+    Ligero = 1,
+    Fractal = 2
+};
+
+/**
+ * @brief Proof system used to prove a padded libiop constraint system.
+ *
+ * Aurora gives the smallest proofs, Ligero proves much faster on small and medium circuits but its proofs
+ * grow with the square root of the circuit. Fractal preprocesses each circuit shape once, after which
+ * verification is sublinear in the circuit. The shape id names the circuit for backends that preprocess it.
+ */
+class ProofBackend
+{
+public:
+    virtual std::vector<unsigned char> prove(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                             const libiop::r1cs_auxiliary_input<FieldT> &aux) = 0;
+    virtual bool verify(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                        const std::vector<unsigned char> &proof) = 0;
+
+    virtual ~ProofBackend() = default;
+
+    // shared, stateless instance of the backend, throws for unknown types
+    static ProofBackend &get(ProofBackendType type);
+
+    static ProofBackendType from_name(const std::string &name);
+    static std::string name(ProofBackendType type);
+};
+
+class AuroraBackend : public ProofBackend
+{
+public:
+    std::vector<unsigned char> prove(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                     const libiop::r1cs_auxiliary_input<FieldT> &aux) override;
+    bool verify(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                        const std::vector<unsigned char> &proof) override;
+};
+
+class LigeroBackend : public ProofBackend
+{
+public:
+    std::vector<unsigned char> prove(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                     const libiop::r1cs_auxiliary_input<FieldT> &aux) override;
+    bool verify(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                        const std::vector<unsigned char> &proof) override;
+};
+
+class FractalBackend : public ProofBackend
+{
+public:
+    std::vector<unsigned char> prove(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                     const libiop::r1cs_auxiliary_input<FieldT> &aux) override;
+    bool verify(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                const std::vector<unsigned char> &proof) override;
+};
+
+/**
+ * @brief Picks the backend of new proofs by the number of padded constraints.
+ *
+ * Bands come from config["chain"]["proof_backends"], e.g.
+ * [{"max_constraints": 65536, "backend": "ligero"}, {"backend": "aurora"}]. The first band whose
+ * max_constraints covers the circuit is used, a band without max_constraints covers everything. Without
+ * bands, or when none matches, Aurora is used.
+ */
+class ProofBackendPolicy
+{
+public:
+    void configure(const json &bands);
+    ProofBackendType select(std::size_t num_constraints);
+
+    static ProofBackendPolicy &instance();
+
+private:
+    std::mutex mu_;
+    std::vector<std::pair<std::size_t, ProofBackendType>> bands_;
+};
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef DIPLO_PUBLIC_KEY_CACHE_HPP
+#define DIPLO_PUBLIC_KEY_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "openfhe.h"
+#include "key/key-ser.h"
+
+using namespace lbcrypto;
+
+/**
+ * @brief Process-wide cache of deserialized public keys, keyed by the hash of their serialization.
+ *
+ * A deserialization cache: computations relayed, stored and carried by blocks with the same public key
+ * share one deserialized key instead of each parsing its own. The least recently used entries are evicted
+ * once the memory of their serializations and polynomials exceeds the budget.
+ */
+class PublicKeyCache
+{
+public:
+    struct Entry
+    {
+        PublicKey<DCRTPoly> key_;
+        // serialized key as received, shared by the computations using it
+        std::shared_ptr<const std::string> serialized_;
+        std::vector<unsigned char> digest_;
+        std::size_t bytes_;
+    };
+
+    explicit PublicKeyCache(std::size_t capacity_bytes);
+
+    /**
+     * @brief Returns the entry of a serialized public key, deserializing it on a miss.
+     */
+    std::shared_ptr<const Entry> get(const std::string &serialized);
+
+    void set_capacity(std::size_t capacity_bytes);
+
+    std::size_t size();
+    std::size_t bytes();
+
+    static PublicKeyCache &instance();
+
+    static std::vector<unsigned char> digest(const std::string &serialized);
+    // memory of the polynomials of a deserialized key
+    static std::size_t key_bytes(const PublicKey<DCRTPoly> &key);
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<const Entry>> Item;
+
+    void evict();
+
+    std::size_t capacity_bytes_;
+    std::size_t bytes_;
+    std::mutex mu_;
+    // most recently used first
+    std::list<Item> entries_;
+    std::unordered_map<std::string, std::list<Item>::iterator> index_;
+};
+
+#endif
@@ -0,0 +1,57 @@
+#ifndef DIPLO_R1CS_CACHE_HPP
+#define DIPLO_R1CS_CACHE_HPP
+
+#include <cstddef>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "proofsystem/proofsystem_libsnark.h"
+#include "libiop/relations/r1cs.hpp"
+
+/**
+ * @brief Process-wide cache of padded libiop constraint systems.
+ *
+ * The constraint system of a computation only depends on its shape: the scheduled program, the crypto
+ * parameters, the levels of the inputs and the relinearization keys. Computations with the same shape key
+ * share one constraint system, so it is derived, optimized, converted and padded once. The least recently
+ * used entries are evicted past the capacity.
+ */
+class R1CSCache
+{
+public:
+    typedef libiop::r1cs_constraint_system<FieldT> ConstraintSystem;
+
+    struct Circuit
+    {
+        ConstraintSystem cs_;
+        // sizes before padding
+        std::size_t num_constraints_;
+        std::size_t num_inputs_;
+        // auxiliary variables left by the optimizer, see optimize_r1cs_constraint_system
+        std::vector<std::size_t> kept_aux_;
+    };
+
+    explicit R1CSCache(std::size_t capacity);
+
+    std::shared_ptr<const Circuit> get(const std::vector<unsigned char> &key);
+    void put(const std::vector<unsigned char> &key, std::shared_ptr<const Circuit> circuit);
+
+    std::size_t size();
+
+    static R1CSCache &instance();
+
+private:
+    typedef std::pair<std::string, std::shared_ptr<const Circuit>> Entry;
+
+    std::size_t capacity_;
+    std::mutex mu_;
+    // most recently used first
+    std::list<Entry> entries_;
+    std::unordered_map<std::string, std::list<Entry>::iterator> index_;
+};
+
+#endif
@@ -1,11 +1,32 @@
 #ifndef DIPLO_CONV_HPP
 #define DIPLO_CONV_HPP
 
+#include <cstddef>
+#include <vector>
+
 #include "libsnark/relations/variable.hpp"
 #include "libsnark/relations/constraint_satisfaction_problems/r1cs/r1cs.hpp"
 #include "libiop/relations/r1cs.hpp"
 #include "libiop/relations/variable.hpp"
 
+/**
+ * @brief Variable layout of a protoboard whose public output was allocated after the circuit.
+ *
+ * Variables are 1-based, 0 is the constant. The inputs are [1, num_inputs], the outputs are
+ * (first_output, first_output + num_outputs] and everything else is auxiliary. libiop expects all public
+ * variables first, so the outputs are moved right after the inputs and the auxiliary variables allocated
+ * before them are shifted up.
+ */
+struct PublicOutputLayout
+{
+    std::size_t num_inputs;
+    std::size_t first_output;
+    std::size_t num_outputs;
+
+    // index of a protoboard variable in the libiop constraint system
+    std::size_t map(std::size_t idx) const;
+};
+
 template <typename FieldT>
 void libsnark_to_libiop_linear_term(const libsnark::linear_term<FieldT> &ls_lt, libiop::linear_term<FieldT> &liop_lt);
 
@@ -18,6 +39,66 @@ void libsnark_to_libiop_r1cs_constraint(const libsnark::r1cs_constraint<FieldT>
 template <typename FieldT>
 void libsnark_to_libiop_r1cs_constraint_system(const libsnark::r1cs_constraint_system<FieldT> &ls_cons_system, libiop::r1cs_constraint_system<FieldT> &liop_const_system);
 
+template <typename FieldT>
+void libsnark_to_libiop_r1cs_constraint_system(const libsnark::r1cs_constraint_system<FieldT> &ls_cons_system, libiop::r1cs_constraint_system<FieldT> &liop_const_system, const PublicOutputLayout &layout);
+
+/**
+ * @brief Converts and pads for Aurora in one pass.
+ *
+ * Produces the same constraint system as libsnark_to_libiop_r1cs_constraint_system followed by
+ * pad_constraint_system_for_aurora, but computes the padded layout first and writes every constraint
+ * once, already re-indexed, into pre-sized storage. Constraints are converted in parallel with MULTICORE.
+ */
+template <typename FieldT>
+void libsnark_to_padded_libiop_r1cs_constraint_system(const libsnark::r1cs_constraint_system<FieldT> &ls_cons_system, libiop::r1cs_constraint_system<FieldT> &liop_const_system, const PublicOutputLayout &layout);
+
+/**
+ * @brief Simplifies a protoboard constraint system before it is converted.
+ *
+ * Moves the public variables first according to the layout, then:
+ * - merges repeated variables and drops zero terms in every linear combination
+ * - treats constraints with a constant A or B as linear equations and uses them to substitute one
+ *   auxiliary variable everywhere else, dropping the constraint (only for short definitions, so the
+ *   system does not get denser)
+ * - drops constraints that became trivially satisfied
+ * - renumbers the auxiliary variables that are still used
+ *
+ * The result has the public variables first, so it is converted with an identity layout.
+ *
+ * @param kept_aux receives, for every auxiliary variable of the result, its position in the auxiliary
+ * input of the unoptimized system
+ */
+template <typename FieldT>
+void optimize_r1cs_constraint_system(libsnark::r1cs_constraint_system<FieldT> &cs, const PublicOutputLayout &layout, std::vector<std::size_t> &kept_aux);
+
+// padded libiop system along with the sizes it had before padding
+template <typename FieldT>
+struct R1CSPart
+{
+    const libiop::r1cs_constraint_system<FieldT> *cs;
+    std::size_t num_constraints;
+    std::size_t num_inputs;
+    std::size_t num_auxiliary;
+};
+
+/**
+ * @brief Places independent padded systems side by side in one padded system.
+ *
+ * The public variables of all parts come first, in order, followed by their auxiliary variables in the
+ * same order, so the assignments are concatenated the same way. The padding of the parts is dropped and
+ * the result is padded once.
+ */
+template <typename FieldT>
+void concatenate_padded_r1cs_constraint_systems(const std::vector<R1CSPart<FieldT>> &parts, libiop::r1cs_constraint_system<FieldT> &out);
+
+// drops the auxiliary values of variables removed by the optimizer
+template <typename FieldT>
+void compact_auxiliary_input(libiop::r1cs_auxiliary_input<FieldT> &aux, const std::vector<std::size_t> &kept_aux);
+
+// splits a full protoboard assignment into the libiop primary and auxiliary inputs, reusing its storage
+template <typename FieldT>
+void split_assignment(libsnark::r1cs_variable_assignment<FieldT> &&full, const PublicOutputLayout &layout, libiop::r1cs_primary_input<FieldT> &prim, libiop::r1cs_auxiliary_input<FieldT> &aux);
+
 template <typename FieldT>
 void pad_constraints_to_next_power_of_two(libiop::r1cs_constraint_system<FieldT> &cs);
 
@@ -25,10 +106,10 @@ template <typename FieldT>
 void pad_constraint_system_for_aurora(libiop::r1cs_constraint_system<FieldT> &cs);
 
 template <typename FieldT>
-void pad_primary_input_to_match_cs(libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_primary_input<FieldT> &prim);
+void pad_primary_input_to_match_cs(const libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_primary_input<FieldT> &prim);
 
 template <typename FieldT>
-void pad_auxiliary_input_to_match_cs(libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_auxiliary_input<FieldT> &aux);
+void pad_auxiliary_input_to_match_cs(const libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_auxiliary_input<FieldT> &aux);
 
 #include "conv.tcc"
 
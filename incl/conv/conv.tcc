@@ -3,6 +3,10 @@
 #include "libiop/relations/r1cs.hpp"
 #include "libiop/relations/variable.hpp"
 
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+
 template <typename FieldT>
 void libsnark_to_libiop_linear_term(const libsnark::linear_term<FieldT> &ls_lt, libiop::linear_term<FieldT> &liop_lt)
 {
@@ -42,6 +46,382 @@ void libsnark_to_libiop_r1cs_constraint_system(const libsnark::r1cs_constraint_s
     }
 }
 
+inline std::size_t PublicOutputLayout::map(std::size_t idx) const
+{
+    if (idx <= num_inputs || idx > first_output + num_outputs)
+    {
+        return idx;
+    }
+    if (idx > first_output)
+    {
+        // output, goes right after the inputs
+        return idx - first_output + num_inputs;
+    }
+    // auxiliary variable allocated before the outputs
+    return idx + num_outputs;
+}
+
+template <typename FieldT>
+void libsnark_to_libiop_r1cs_constraint_system(const libsnark::r1cs_constraint_system<FieldT> &ls_cons_system, libiop::r1cs_constraint_system<FieldT> &liop_const_system, const PublicOutputLayout &layout)
+{
+    // the split stored in the libsnark system does not know about the late outputs
+    liop_const_system.primary_input_size_ = layout.num_inputs + layout.num_outputs;
+    liop_const_system.auxiliary_input_size_ = ls_cons_system.num_variables() - liop_const_system.primary_input_size_;
+    liop_const_system.constraints_.reserve(ls_cons_system.constraints.size());
+    for (const auto &c : ls_cons_system.constraints)
+    {
+        libiop::r1cs_constraint<FieldT> new_cons;
+        libsnark_to_libiop_r1cs_constraint(c, new_cons);
+        for (auto *lc : {&new_cons.a_, &new_cons.b_, &new_cons.c_})
+        {
+            for (auto &lt : lc->terms)
+            {
+                lt.index_ = layout.map(lt.index_);
+            }
+        }
+        liop_const_system.add_constraint(new_cons);
+    }
+}
+
+template <typename FieldT>
+void libsnark_to_padded_libiop_r1cs_constraint_system(const libsnark::r1cs_constraint_system<FieldT> &ls_cons_system, libiop::r1cs_constraint_system<FieldT> &liop_const_system, const PublicOutputLayout &layout)
+{
+    // same padding as pad_constraint_system_for_aurora, computed before converting
+    const std::size_t primary_input_size = layout.num_inputs + layout.num_outputs;
+    const std::size_t padded_primary_input_size = (1ull << libff::log2(primary_input_size + 1)) - 1;
+    const std::size_t input_pad_amount = padded_primary_input_size - primary_input_size;
+
+    const std::size_t num_variables = ls_cons_system.num_variables() + input_pad_amount;
+    const std::size_t padded_num_variables = (1ull << libff::log2(num_variables + 1)) - 1;
+
+    const std::size_t num_constraints = ls_cons_system.constraints.size();
+    const std::size_t padded_num_constraints = 1ull << libff::log2(num_constraints);
+
+    liop_const_system.primary_input_size_ = padded_primary_input_size;
+    liop_const_system.auxiliary_input_size_ = padded_num_variables - padded_primary_input_size;
+    liop_const_system.constraints_.clear();
+    liop_const_system.constraints_.resize(padded_num_constraints);
+
+    auto convert = [&layout, primary_input_size, input_pad_amount](const libsnark::linear_combination<FieldT> &ls_lc, libiop::linear_combination<FieldT> &liop_lc)
+    {
+        liop_lc.terms.resize(ls_lc.terms.size());
+        for (std::size_t j = 0; j < ls_lc.terms.size(); ++j)
+        {
+            auto idx = layout.map(ls_lc.terms[j].index);
+            liop_lc.terms[j].index_ = (idx > primary_input_size) ? idx + input_pad_amount : idx;
+            liop_lc.terms[j].coeff_ = ls_lc.terms[j].coeff;
+        }
+    };
+
+    // every constraint is written to its own slot, so ranges can be converted independently
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::size_t i = 0; i < num_constraints; ++i)
+    {
+        const auto &c = ls_cons_system.constraints[i];
+        auto &new_cons = liop_const_system.constraints_[i];
+        convert(c.a, new_cons.a_);
+        convert(c.b, new_cons.b_);
+        convert(c.c, new_cons.c_);
+    }
+
+    const libiop::linear_combination<FieldT> zero(0);
+    for (std::size_t i = num_constraints; i < padded_num_constraints; ++i)
+    {
+        auto &pad_cons = liop_const_system.constraints_[i];
+        pad_cons.a_ = zero;
+        pad_cons.b_ = zero;
+        pad_cons.c_ = zero;
+    }
+}
+
+// longest linear definition substituted by the optimizer
+constexpr std::size_t R1CS_MAX_SUBSTITUTION_TERMS = 8;
+
+template <typename FieldT>
+void normalize_linear_combination(std::vector<libsnark::linear_term<FieldT>> &terms)
+{
+    std::sort(terms.begin(), terms.end(), [](const libsnark::linear_term<FieldT> &a, const libsnark::linear_term<FieldT> &b)
+              { return a.index < b.index; });
+
+    std::size_t out = 0;
+    for (std::size_t i = 0; i < terms.size(); ++i)
+    {
+        if (out > 0 && terms[out - 1].index == terms[i].index)
+        {
+            terms[out - 1].coeff = terms[out - 1].coeff + terms[i].coeff;
+            continue;
+        }
+        if (out > 0 && terms[out - 1].coeff.is_zero())
+        {
+            --out;
+        }
+        terms[out++] = terms[i];
+    }
+    if (out > 0 && terms[out - 1].coeff.is_zero())
+    {
+        --out;
+    }
+    terms.resize(out);
+}
+
+template <typename FieldT>
+void optimize_r1cs_constraint_system(libsnark::r1cs_constraint_system<FieldT> &cs, const PublicOutputLayout &layout, std::vector<std::size_t> &kept_aux)
+{
+    typedef std::vector<libsnark::linear_term<FieldT>> Terms;
+
+    const std::size_t num_public = layout.num_inputs + layout.num_outputs;
+    const std::size_t num_variables = cs.num_variables();
+
+    // definitions of substituted variables, in terms of variables that were live when they were made
+    std::vector<Terms> definition(num_variables + 1);
+    std::vector<char> eliminated(num_variables + 1, 0);
+
+    auto expand = [&definition, &eliminated](Terms &terms)
+    {
+        // a definition may use variables eliminated after it, so repeat until none is left
+        bool changed = true;
+        while (changed)
+        {
+            changed = false;
+            Terms out;
+            out.reserve(terms.size());
+            for (const auto &t : terms)
+            {
+                if (!eliminated[t.index])
+                {
+                    out.push_back(t);
+                    continue;
+                }
+                changed = true;
+                for (const auto &d : definition[t.index])
+                {
+                    out.push_back(d);
+                    out.back().coeff = d.coeff * t.coeff;
+                }
+            }
+            terms.swap(out);
+        }
+        normalize_linear_combination(terms);
+    };
+
+    auto is_constant = [](const Terms &terms)
+    {
+        return terms.empty() || (terms.size() == 1 && terms[0].index == 0);
+    };
+
+    std::vector<libsnark::r1cs_constraint<FieldT>> kept;
+    kept.reserve(cs.constraints.size());
+    for (auto &c : cs.constraints)
+    {
+        for (auto *lc : {&c.a, &c.b, &c.c})
+        {
+            for (auto &t : lc->terms)
+            {
+                t.index = layout.map(t.index);
+            }
+            expand(lc->terms);
+        }
+
+        bool const_a = is_constant(c.a.terms);
+        if (const_a || is_constant(c.b.terms))
+        {
+            // k * L = C is the linear equation k * L - C = 0
+            const auto &k_terms = const_a ? c.a.terms : c.b.terms;
+            auto k = k_terms.empty() ? FieldT::zero() : k_terms[0].coeff;
+
+            Terms linear = const_a ? c.b.terms : c.a.terms;
+            for (auto &t : linear)
+            {
+                t.coeff = t.coeff * k;
+            }
+            for (const auto &t : c.c.terms)
+            {
+                linear.push_back(t);
+                linear.back().coeff = -t.coeff;
+            }
+            normalize_linear_combination(linear);
+
+            if (linear.empty())
+            {
+                // always satisfied
+                continue;
+            }
+
+            // terms are sorted, so the last one is auxiliary if there is any
+            const auto &pivot = linear.back();
+            if (pivot.index > num_public && linear.size() <= R1CS_MAX_SUBSTITUTION_TERMS + 1)
+            {
+                // x = -(1 / c_x) * (rest of the equation)
+                auto scale = -pivot.coeff.inverse();
+                auto x = pivot.index;
+                linear.pop_back();
+                for (auto &t : linear)
+                {
+                    t.coeff = t.coeff * scale;
+                }
+                definition[x] = std::move(linear);
+                eliminated[x] = 1;
+                continue;
+            }
+        }
+        kept.push_back(std::move(c));
+    }
+
+    // substitute the variables eliminated after a constraint was kept, and find the variables still in use
+    std::vector<char> used(num_variables + 1, 0);
+    std::size_t out = 0;
+    for (auto &c : kept)
+    {
+        for (auto *lc : {&c.a, &c.b, &c.c})
+        {
+            expand(lc->terms);
+        }
+
+        bool zero_product = c.a.terms.empty() || c.b.terms.empty();
+        if (zero_product && c.c.terms.empty())
+        {
+            continue;
+        }
+
+        for (auto *lc : {&c.a, &c.b, &c.c})
+        {
+            for (const auto &t : lc->terms)
+            {
+                used[t.index] = 1;
+            }
+        }
+        kept[out++] = std::move(c);
+    }
+    kept.resize(out);
+
+    // public variables keep their index, used auxiliary variables are packed after them
+    std::vector<std::size_t> new_index(num_variables + 1);
+    for (std::size_t i = 0; i <= num_public; ++i)
+    {
+        new_index[i] = i;
+    }
+    kept_aux.clear();
+    for (std::size_t i = num_public + 1; i <= num_variables; ++i)
+    {
+        if (used[i])
+        {
+            kept_aux.push_back(i - num_public - 1);
+            new_index[i] = num_public + kept_aux.size();
+        }
+    }
+
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+    for (std::size_t i = 0; i < kept.size(); ++i)
+    {
+        for (auto *lc : {&kept[i].a, &kept[i].b, &kept[i].c})
+        {
+            for (auto &t : lc->terms)
+            {
+                t.index = new_index[t.index];
+            }
+        }
+    }
+
+    cs.constraints = std::move(kept);
+    cs.primary_input_size = num_public;
+    cs.auxiliary_input_size = kept_aux.size();
+}
+
+template <typename FieldT>
+void concatenate_padded_r1cs_constraint_systems(const std::vector<R1CSPart<FieldT>> &parts, libiop::r1cs_constraint_system<FieldT> &out)
+{
+    std::size_t num_inputs = 0, num_auxiliary = 0, num_constraints = 0;
+    for (const auto &part : parts)
+    {
+        num_inputs += part.num_inputs;
+        num_auxiliary += part.num_auxiliary;
+        num_constraints += part.num_constraints;
+    }
+
+    const std::size_t padded_primary_input_size = (1ull << libff::log2(num_inputs + 1)) - 1;
+    const std::size_t padded_num_variables = (1ull << libff::log2(padded_primary_input_size + num_auxiliary + 1)) - 1;
+    const std::size_t padded_num_constraints = 1ull << libff::log2(num_constraints);
+
+    out.primary_input_size_ = padded_primary_input_size;
+    out.auxiliary_input_size_ = padded_num_variables - padded_primary_input_size;
+    out.constraints_.clear();
+    out.constraints_.resize(padded_num_constraints);
+
+    std::size_t input_offset = 0, aux_offset = padded_primary_input_size, constraint_offset = 0;
+    for (const auto &part : parts)
+    {
+        const auto part_primary_input_size = part.cs->primary_input_size_;
+        auto shift = [&](libiop::linear_combination<FieldT> &lc)
+        {
+            for (auto &t : lc.terms)
+            {
+                if (t.index_ == 0)
+                {
+                    continue;
+                }
+                // indices between the inputs and the padded input size are padding and never used
+                t.index_ = (t.index_ > part_primary_input_size) ? t.index_ - part_primary_input_size + aux_offset : t.index_ + input_offset;
+            }
+        };
+
+#ifdef MULTICORE
+#pragma omp parallel for schedule(static)
+#endif
+        for (std::size_t i = 0; i < part.num_constraints; ++i)
+        {
+            auto &c = out.constraints_[constraint_offset + i];
+            c = part.cs->constraints_[i];
+            shift(c.a_);
+            shift(c.b_);
+            shift(c.c_);
+        }
+
+        input_offset += part.num_inputs;
+        aux_offset += part.num_auxiliary;
+        constraint_offset += part.num_constraints;
+    }
+
+    const libiop::linear_combination<FieldT> zero(0);
+    for (std::size_t i = num_constraints; i < padded_num_constraints; ++i)
+    {
+        auto &pad_cons = out.constraints_[i];
+        pad_cons.a_ = zero;
+        pad_cons.b_ = zero;
+        pad_cons.c_ = zero;
+    }
+}
+
+template <typename FieldT>
+void compact_auxiliary_input(libiop::r1cs_auxiliary_input<FieldT> &aux, const std::vector<std::size_t> &kept_aux)
+{
+    // kept positions are increasing, so values can be moved down in place
+    for (std::size_t i = 0; i < kept_aux.size(); ++i)
+    {
+        aux[i] = std::move(aux[kept_aux[i]]);
+    }
+    aux.resize(kept_aux.size());
+}
+
+template <typename FieldT>
+void split_assignment(libsnark::r1cs_variable_assignment<FieldT> &&full, const PublicOutputLayout &layout, libiop::r1cs_primary_input<FieldT> &prim, libiop::r1cs_auxiliary_input<FieldT> &aux)
+{
+    // full assignment does not include the constant, so variable i is at i - 1
+    auto begin = full.begin();
+    prim.clear();
+    prim.reserve(layout.num_inputs + layout.num_outputs);
+    prim.insert(prim.end(), std::make_move_iterator(begin), std::make_move_iterator(begin + layout.num_inputs));
+    prim.insert(prim.end(), std::make_move_iterator(begin + layout.first_output), std::make_move_iterator(begin + layout.first_output + layout.num_outputs));
+
+    // what is left is the auxiliary input, in order
+    full.erase(full.begin() + layout.first_output, full.begin() + layout.first_output + layout.num_outputs);
+    full.erase(full.begin(), full.begin() + layout.num_inputs);
+    aux = std::move(full);
+}
+
 template <typename FieldT>
 void pad_constraints_to_next_power_of_two(libiop::r1cs_constraint_system<FieldT> &cs)
 {
@@ -122,25 +502,24 @@ void pad_constraint_system_for_aurora(libiop::r1cs_constraint_system<FieldT> &cs
 }
 
 template <typename FieldT>
-void pad_primary_input_to_match_cs(libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_primary_input<FieldT> &prim)
+void pad_primary_input_to_match_cs(const libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_primary_input<FieldT> &prim)
 {
-    auto left = cs.num_inputs() - prim.size();
-    while (left > 0)
+    // only ever pads, a longer assignment belongs to another system
+    if (prim.size() > cs.num_inputs())
     {
-        prim.push_back(FieldT(0));
-        --left;
+        throw std::invalid_argument("Primary input is larger than the constraint system expects.");
     }
+    prim.resize(cs.num_inputs(), FieldT(0));
 }
 
 template <typename FieldT>
-void pad_auxiliary_input_to_match_cs(libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_auxiliary_input<FieldT> &aux)
+void pad_auxiliary_input_to_match_cs(const libiop::r1cs_constraint_system<FieldT> &cs, libiop::r1cs_auxiliary_input<FieldT> &aux)
 {
-    auto left = cs.auxiliary_input_size_ - aux.size();
-    while (left > 0)
+    if (aux.size() > cs.auxiliary_input_size_)
     {
-        aux.push_back(FieldT(0));
-        --left;
+        throw std::invalid_argument("Auxiliary input is larger than the constraint system expects.");
     }
+    aux.resize(cs.auxiliary_input_size_, FieldT(0));
 }
 
 /*
@@ -9,6 +9,15 @@
 
 #include "message.pb.h"
 
+// what computations are bound to, see BlockHeader::binding_prefix
+// the serialized header without proofs
+constexpr uint32_t BINDING_FULL_HEADER = 0;
+// the digest of the serialized header without proofs
+constexpr uint32_t BINDING_HEADER_DIGEST = 1;
+
+// written before a block proof, where the size of the first computation proof would be. No proof has this size
+constexpr uint64_t BLOCK_PROOF_TAG = UINT64_MAX;
+
 class BlockHeader
 {
 public:
@@ -17,16 +26,28 @@ public:
     std::time_t timestamp_;
     uint32_t difficulty_;
     std::vector<std::shared_ptr<Computation>> computations_;
+    // single proof of all computations (see ProofAggregator), empty when each computation has its own
+    std::vector<unsigned char> block_proof_;
+    uint32_t binding_version_ = BINDING_FULL_HEADER;
 
     BlockHeader() = default;
     BlockHeader(std::shared_ptr<BlockHeader> prev_block_header, const std::vector<unsigned char> &merkle_root, std::time_t timestamp, uint32_t difficulty, const std::vector<std::shared_ptr<Computation>> &computations);
     BlockHeader(const std::vector<unsigned char> &prev_hash, const std::vector<unsigned char> &merkle_root, std::time_t timestamp, uint32_t difficulty, const std::vector<std::shared_ptr<Computation>> &computations);
 
     std::vector<unsigned char> serialize(bool include_proofs = true);
+    void serialize_to(util::ByteSink &sink, bool include_proofs = true);
     std::vector<unsigned char> hash(bool force = false);
 
     std::vector<unsigned char> prev_hash();
 
+    /**
+     * @brief Data the computations of this header are bound to, followed by their index (8 bytes).
+     *
+     * Either the serialized header without proofs or, for BINDING_HEADER_DIGEST, its digest, so binding
+     * does not depend on the size of the block. Both commit to every computation and to the previous block.
+     */
+    std::vector<unsigned char> binding_prefix();
+
     ProtoBlockHeader to_proto() const;
 
     static BlockHeader from_proto(const ProtoBlockHeader &proto, const ComputationFactory &comp_factory);
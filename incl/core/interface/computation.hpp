@@ -5,8 +5,32 @@
 #include <cstdint>
 #include <atomic>
 #include <memory>
+#include <string>
 
 #include "message.pb.h"
+#include "util/byte_sink.hpp"
+
+// predicted cost of proving a computation, made without evaluating it
+struct CostEstimate
+{
+    uint64_t multiplications = 0;
+    uint64_t additions = 0;
+    // operations with a plaintext constant
+    uint64_t plaintext_ops = 0;
+    uint64_t key_switches = 0;
+    uint64_t rescales = 0;
+    uint64_t constraints = 0;
+    uint64_t variables = 0;
+    // sizes of the padded constraint system the backend proves
+    uint64_t padded_constraints = 0;
+    uint64_t padded_variables = 0;
+    // Aurora codeword domain of the padded system
+    uint64_t aurora_domain = 0;
+    // backend new proofs of this size are made with
+    std::string backend;
+    double prove_s = 0;
+    double verify_s = 0;
+};
 
 class Computation
 {
@@ -17,6 +41,9 @@ public:
     // should contain the computation before it was bound to this block+miner
     // then, the proofs could go in the header
     virtual std::vector<unsigned char> serialize(bool include_output) = 0;
+    // writes the bytes of serialize, for hashing without building them
+    virtual void serialize_to(util::ByteSink &sink, bool include_output) = 0;
+    virtual std::size_t serialized_size(bool include_output) = 0;
     // virtual std::vector<unsigned char> deserialize() = 0;
     virtual std::vector<unsigned char> hash() = 0;
     virtual std::vector<unsigned char> hash_force() = 0;
@@ -31,7 +58,9 @@ public:
     // virtual void deserialize(const std::vector<unsigned char> &) = 0;
 
     virtual uint32_t difficulty() = 0;
+    virtual CostEstimate estimate_cost() = 0;
     virtual void set_stop_flag(std::shared_ptr<std::atomic<bool>>) = 0;
+    virtual std::shared_ptr<std::atomic<bool>> stop_flag() const = 0;
 
     virtual ProtoComputation to_proto() const = 0;
 
@@ -0,0 +1,24 @@
+#ifndef DIPLO_PROOF_AGGREGATOR_HPP
+#define DIPLO_PROOF_AGGREGATOR_HPP
+
+#include <vector>
+#include <memory>
+
+#include "core/interface/computation.hpp"
+
+/**
+ * @brief Proves all the computations of a block header with a single argument.
+ *
+ * The computations must already be bound to the header. The proof is stored in the header instead of
+ * the computations.
+ */
+class ProofAggregator
+{
+public:
+    virtual std::vector<unsigned char> prove(const std::vector<std::shared_ptr<Computation>> &computations) = 0;
+    virtual bool verify(const std::vector<std::shared_ptr<Computation>> &computations, const std::vector<unsigned char> &proof) = 0;
+
+    virtual ~ProofAggregator() = default;
+};
+
+#endif
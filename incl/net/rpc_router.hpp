@@ -14,7 +14,9 @@ enum class RPCType
     Test = 0,
     Transaction,
     Computation,
-    Output
+    Output,
+    Metrics,
+    Estimate
 };
 
 class RPCRouter
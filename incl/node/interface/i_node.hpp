@@ -29,6 +29,8 @@ public:
     virtual void rpc_handle_transaction(const json &req, json &resp) = 0;
     virtual void rpc_handle_computation(const json &req, json &resp) = 0;
     virtual void rpc_handle_output(const json &req, json &resp) = 0;
+    virtual void rpc_handle_metrics(const json &req, json &resp) = 0;
+    virtual void rpc_handle_estimate(const json &req, json &resp) = 0;
 
     virtual std::vector<unsigned char> handle_inv_block(const InvBlock &msg) = 0;
     virtual std::vector<unsigned char> handle_get_block(const GetBlock &msg) = 0;
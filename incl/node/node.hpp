@@ -53,6 +53,9 @@ public:
     void rpc_handle_transaction(const json &msg, json &resp) override;
     void rpc_handle_computation(const json &req, json &resp) override;
     void rpc_handle_output(const json &req, json &resp) override;
+    void rpc_handle_metrics(const json &req, json &resp) override;
+    // predicted cost of a computation, without adding it to the store
+    void rpc_handle_estimate(const json &req, json &resp) override;
 
     void handle_add_valid_block(std::shared_ptr<Block> block);
 
@@ -102,6 +105,9 @@ private:
     std::condition_variable sync_cv_;
     bool is_synced_;
     std::shared_ptr<Peer> sync_peer_;
+
+    // padded sizes whose Aurora parameters are built at start
+    json aurora_warmup_;
 };
 
 #endif
@@ -0,0 +1,77 @@
+#ifndef DIPLO_BYTE_SINK_HPP
+#define DIPLO_BYTE_SINK_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "sodium.h"
+
+namespace util
+{
+    /**
+     * @brief Destination of a serialization written field by field.
+     *
+     * Serializers that write to a sink can be hashed or measured without building the serialized buffer.
+     */
+    class ByteSink
+    {
+    public:
+        virtual void write(const unsigned char *data, std::size_t size) = 0;
+
+        void write(const std::vector<unsigned char> &bytes);
+        void write(const std::string &bytes);
+        // big endian, as util::uint32_to_vector_big_endian and util::uint64_to_vector_big_endian
+        void write_uint32(uint32_t num);
+        void write_uint64(uint64_t num);
+        // 8 byte big endian size, then the bytes
+        void write_sized(const std::vector<unsigned char> &bytes);
+        void write_sized(const std::string &bytes);
+
+        virtual ~ByteSink() = default;
+    };
+
+    // appends to a vector
+    class VectorSink : public ByteSink
+    {
+    public:
+        explicit VectorSink(std::vector<unsigned char> &out);
+
+        using ByteSink::write;
+        void write(const unsigned char *data, std::size_t size) override;
+
+    private:
+        std::vector<unsigned char> &out_;
+    };
+
+    // only counts the bytes written
+    class SizeSink : public ByteSink
+    {
+    public:
+        using ByteSink::write;
+        void write(const unsigned char *, std::size_t size) override;
+
+        std::size_t size() const;
+
+    private:
+        std::size_t size_ = 0;
+    };
+
+    // BLAKE2b of the bytes written, the same digest as crypto_generichash over their concatenation
+    class HashSink : public ByteSink
+    {
+    public:
+        HashSink();
+
+        using ByteSink::write;
+        void write(const unsigned char *data, std::size_t size) override;
+
+        std::vector<unsigned char> digest();
+
+    private:
+        crypto_generichash_state state_;
+    };
+};
+
+#endif
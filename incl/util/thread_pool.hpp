@@ -0,0 +1,95 @@
+#ifndef DIPLO_THREAD_POOL_HPP
+#define DIPLO_THREAD_POOL_HPP
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * @brief Work-stealing thread pool.
+ *
+ * Every worker owns a deque. Tasks submitted from inside a worker are pushed to its own deque and
+ * popped LIFO by the owner, while idle workers steal FIFO from the other deques. Tasks submitted from
+ * outside the pool are spread round-robin across the deques.
+ */
+class ThreadPool
+{
+public:
+    explicit ThreadPool(std::size_t threads);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool &) = delete;
+    ThreadPool &operator=(const ThreadPool &) = delete;
+
+    void submit(std::function<void()> task);
+
+    // executes one pending task on the calling thread, returns false if nothing was found
+    bool try_run_one();
+
+    std::size_t size() const;
+
+    // process-wide pool used for homomorphic evaluation
+    static ThreadPool &compute();
+    // process-wide pool verifying the computation proofs of blocks, of main chain and forks alike
+    static ThreadPool &validation();
+    // size of validation(), only effective before its first use. 0 uses every hardware thread
+    static void set_validation_threads(std::size_t threads);
+
+private:
+    struct WorkQueue
+    {
+        std::mutex mu;
+        std::deque<std::function<void()>> tasks;
+    };
+
+    std::vector<std::unique_ptr<WorkQueue>> queues_;
+    std::vector<std::thread> workers_;
+
+    std::mutex sleep_mu_;
+    std::condition_variable sleep_cv_;
+    bool stop_;
+
+    std::atomic<std::size_t> pending_;
+    std::atomic<std::size_t> next_queue_;
+
+    void worker_loop(std::size_t idx);
+    bool pop_task(std::size_t idx, std::function<void()> &task);
+};
+
+/**
+ * @brief Set of tasks that can be waited on as a unit.
+ *
+ * The first exception thrown by a task cancels the tasks of the group that have not started yet and
+ * is rethrown by wait(). The waiting thread executes pending pool tasks instead of blocking, so groups
+ * can be nested inside pool tasks without exhausting the workers.
+ */
+class TaskGroup
+{
+public:
+    explicit TaskGroup(ThreadPool &pool);
+    ~TaskGroup();
+
+    void run(std::function<void()> task);
+    void wait();
+
+    void cancel();
+    bool is_cancelled() const;
+
+private:
+    ThreadPool &pool_;
+    std::atomic<std::size_t> outstanding_;
+    std::atomic<bool> cancelled_;
+
+    std::mutex mu_;
+    std::condition_variable done_cv_;
+    std::exception_ptr error_;
+};
+
+#endif
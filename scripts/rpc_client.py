@@ -159,6 +159,29 @@ def send_output(config):
         )
 
 
+def send_metrics(config):
+    msg = {"type": 4}
+    response = send_message(config, msg)
+    print(json.dumps(response, indent=4))
+
+
+def send_estimate(config):
+    filename = input("Enter the JSON file name: ")
+
+    try:
+        with open(filename, "r") as file:
+            computation_data = json.load(file)
+
+        computation_data["type"] = 5
+        response = send_message(config, computation_data)
+        print(json.dumps(response, indent=4))
+
+    except FileNotFoundError:
+        print(f"File {filename} not found.")
+    except json.JSONDecodeError:
+        print("Invalid JSON format in the file.")
+
+
 def main():
     config_path = "../config/config.json"
     config = load_config(config_path)
@@ -172,6 +195,8 @@ def main():
         "transaction": send_transaction,
         "computation": send_computation,
         "output": send_output,
+        "metrics": send_metrics,
+        "estimate": send_estimate,
         "exit": lambda config: print("Exiting the terminal UI."),
     }
 
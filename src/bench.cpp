@@ -0,0 +1,803 @@
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <random>
+#include <sstream>
+#include <string>
+
+#include "base64.hpp"
+#include "computer/ast.hpp"
+#include "computer/cost_model.hpp"
+#include "computer/fhe_computer.hpp"
+#include "computer/proof_backend.hpp"
+#include "computer/public_key_cache.hpp"
+#include "nlohmann/json.hpp"
+
+using json = nlohmann::json;
+
+using std::cout, std::endl;
+
+namespace
+{
+    // random expression with `operands` ciphertext indices, mixed operators and parentheses
+    std::string random_expression(std::size_t operands, std::mt19937 &rng)
+    {
+        static const char ops[] = {'+', '-', '*', '*'};
+        std::uniform_int_distribution<int> index(0, 99);
+        std::uniform_int_distribution<int> coin(0, 9);
+
+        std::string expr;
+        expr.reserve(operands * 6);
+        std::size_t open = 0;
+        for (std::size_t i = 0; i < operands; ++i)
+        {
+            if (i > 0)
+            {
+                expr.push_back(ops[rng() % 4]);
+            }
+            if (i + 1 < operands && coin(rng) < 2)
+            {
+                expr.push_back('(');
+                ++open;
+            }
+            expr += std::to_string(index(rng));
+            if (open > 0 && coin(rng) < 2)
+            {
+                expr.push_back(')');
+                --open;
+            }
+        }
+        expr.append(open, ')');
+        return expr;
+    }
+
+    // long left-leaning chain of products, separated by an addition every 64 operands
+    std::string chain_expression(std::size_t operands)
+    {
+        std::string expr;
+        expr.reserve(operands * 4);
+        for (std::size_t i = 0; i < operands; ++i)
+        {
+            if (i > 0)
+            {
+                expr.push_back((i % 64 == 0) ? '+' : '*');
+            }
+            expr += std::to_string(i % 100);
+        }
+        return expr;
+    }
+
+    double ms_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    void bench_ast(std::size_t max_operands)
+    {
+        std::mt19937 rng(42);
+        cout << std::left << std::setw(8) << "shape" << std::setw(10) << "operands" << std::setw(10) << "bytes"
+             << std::setw(12) << "parse(ms)" << std::setw(12) << "build(ms)" << std::setw(8) << "depth" << "instructions" << endl;
+        cout << std::fixed << std::setprecision(3);
+
+        for (std::size_t operands = 1000; operands <= max_operands; operands *= 10)
+        {
+            for (const std::string shape : {"random", "chain"})
+            {
+                auto expr = (shape == "random") ? random_expression(operands, rng) : chain_expression(operands);
+
+                auto start = std::chrono::steady_clock::now();
+                auto tokens = ASTree::shunt(expr);
+                auto parse_ms = ms_since(start);
+
+                // builds, rebalances and compiles the program
+                start = std::chrono::steady_clock::now();
+                ASTree tree(tokens);
+                auto build_ms = ms_since(start);
+
+                cout << std::setw(8) << shape << std::setw(10) << operands << std::setw(10) << expr.size()
+                     << std::setw(12) << parse_ms << std::setw(12) << build_ms << std::setw(8) << tree.depth()
+                     << tree.program_.size() << endl;
+            }
+        }
+    }
+
+    // arithmetic of the checks, a prime standing in for the plaintext modulus
+    constexpr int64_t CHECK_MODULUS = 1000003;
+
+    int64_t reduce(int64_t v)
+    {
+        v %= CHECK_MODULUS;
+        return (v < 0) ? v + CHECK_MODULUS : v;
+    }
+
+    int64_t check_input(int32_t idx)
+    {
+        return reduce(7 * static_cast<int64_t>(idx) + 3);
+    }
+
+    struct CheckExpr
+    {
+        std::string text;
+        // value of the expression as written, over check_input
+        int64_t value;
+        // multiplicative depth as written, -1 for a constant
+        int32_t depth;
+    };
+
+    // random expression over ciphertexts 0..9, with constants, powers and parentheses, evaluated as it is built
+    CheckExpr random_check_expression(int depth, std::mt19937 &rng)
+    {
+        std::uniform_int_distribution<int> coin(0, 9);
+        if (depth == 0 || coin(rng) < 3)
+        {
+            if (coin(rng) < 3)
+            {
+                auto k = static_cast<int32_t>(rng() % 21);
+                return {"#" + std::to_string(k), k, -1};
+            }
+            auto idx = static_cast<int32_t>(rng() % 10);
+            return {std::to_string(idx), check_input(idx), 0};
+        }
+
+        static const char ops[] = {'+', '-', '*', '^'};
+        char op = ops[rng() % 4];
+        auto left = random_check_expression(depth - 1, rng);
+        if (op == '^')
+        {
+            int32_t k = 1 + rng() % 9;
+            int64_t value = 1;
+            for (int32_t i = 0; i < k; ++i)
+            {
+                value = reduce(value * left.value);
+            }
+            // square-and-multiply as a balanced product, a constant base stays a constant
+            int32_t bits = 0;
+            while ((1 << bits) < k)
+            {
+                ++bits;
+            }
+            return {"(" + left.text + ")^" + std::to_string(k), value, (left.depth < 0) ? -1 : left.depth + bits};
+        }
+
+        auto right = random_check_expression(depth - 1, rng);
+        auto text = "(" + left.text + op + right.text + ")";
+        switch (op)
+        {
+        case '+':
+            return {text, reduce(left.value + right.value), std::max(left.depth, right.depth)};
+        case '-':
+            return {text, reduce(left.value - right.value), std::max(left.depth, right.depth)};
+        default:
+            // a product by a constant does not add to the depth
+            if (left.depth < 0 || right.depth < 0)
+            {
+                return {text, reduce(left.value * right.value), std::max(left.depth, right.depth)};
+            }
+            return {text, reduce(left.value * right.value), std::max(left.depth, right.depth) + 1};
+        }
+    }
+
+    // runs a scheduled program over check_input, rejecting operands at different levels
+    int64_t run_program(const std::vector<ASTInstr> &program)
+    {
+        std::vector<int64_t> values(program.size());
+        for (std::size_t i = 0; i < program.size(); ++i)
+        {
+            const auto &instr = program[i];
+            auto aligned = [&program, &instr]()
+            {
+                if (program[instr.left_].depth_ != program[instr.right_].depth_)
+                {
+                    throw std::logic_error("Operands at different levels.");
+                }
+            };
+            switch (instr.op_)
+            {
+            case ASTOp::Leaf:
+                values[i] = check_input(instr.val_);
+                break;
+            case ASTOp::Add:
+                aligned();
+                values[i] = reduce(values[instr.left_] + values[instr.right_]);
+                break;
+            case ASTOp::Sub:
+                aligned();
+                values[i] = reduce(values[instr.left_] - values[instr.right_]);
+                break;
+            case ASTOp::Mul:
+                aligned();
+                values[i] = reduce(values[instr.left_] * values[instr.right_]);
+                break;
+            case ASTOp::AddPlain:
+                values[i] = reduce(values[instr.left_] + instr.val_);
+                break;
+            case ASTOp::MulPlain:
+                values[i] = reduce(values[instr.left_] * instr.val_);
+                break;
+            case ASTOp::Relin:
+            case ASTOp::Rescale:
+                values[i] = values[instr.left_];
+                break;
+            default:
+                throw std::logic_error("Unexpected op in scheduled AST program.");
+            }
+        }
+        return values.back();
+    }
+
+    // the balanced, folded, lowered and scheduled program, with and without CSE, against the expression as written
+    bool check_ast(std::size_t count)
+    {
+        std::mt19937 rng(42);
+        std::size_t checked = 0, skipped = 0, failed = 0;
+        for (std::size_t n = 0; n < count; ++n)
+        {
+            auto expr = random_check_expression(1 + rng() % 5, rng);
+            if (expr.depth < 0 || expr.text.find_first_of("+-*^") == std::string::npos)
+            {
+                // nothing encrypted, or nothing to evaluate
+                continue;
+            }
+
+            for (bool cse : {false, true})
+            {
+                try
+                {
+                    ASTree tree(expr.text, cse);
+                    tree.schedule({});
+                    auto value = run_program(tree.program_);
+                    if (value != expr.value || tree.depth() > expr.depth)
+                    {
+                        cout << "MISMATCH " << expr.text << (cse ? " (cse)" : "") << ": " << value << " at depth " << tree.depth()
+                             << ", expected " << expr.value << " at depth " << expr.depth << endl;
+                        ++failed;
+                    }
+                    ++checked;
+                }
+                catch (const std::out_of_range &)
+                {
+                    // folded constant past the range of expressions
+                    ++skipped;
+                }
+                catch (const std::exception &e)
+                {
+                    cout << "ERROR " << expr.text << (cse ? " (cse)" : "") << ": " << e.what() << endl;
+                    ++failed;
+                }
+            }
+        }
+
+        cout << "checked " << checked << ", skipped " << skipped << ", failed " << failed << endl;
+        return failed == 0;
+    }
+
+    bool report(const std::string &name, bool passed)
+    {
+        cout << (passed ? "PASS " : "FAIL ") << name << endl;
+        return passed;
+    }
+
+    // verifies the computation as a validator receiving it would, a throwing verifier counts as a rejection
+    bool verifies(const ProtoComputation &proto)
+    {
+        try
+        {
+            auto verifier = FHEComputer::from_proto(proto);
+            return verifier.verify_proof(verifier.proof());
+        }
+        catch (const std::exception &e)
+        {
+            cout << "verifier threw: " << e.what() << endl;
+            return false;
+        }
+    }
+
+    // proves with every backend, then the proof must be accepted for the computed output and rejected when it is
+    // tampered with, for another output of the same shape and for an output of another shape
+    bool check_proofs(const std::string &path)
+    {
+        std::ifstream ifs(path);
+        json c_json = json::parse(ifs);
+        ifs.close();
+
+        bool passed = true;
+        for (auto type : {ProofBackendType::Aurora, ProofBackendType::Ligero, ProofBackendType::Fractal})
+        {
+            auto name = ProofBackend::name(type);
+            ProofBackendPolicy::instance().configure(json::array({{{"backend", name}}}));
+
+            FHEComputer prover(c_json);
+            prover.generate_proof();
+            auto proto = prover.to_proto();
+            passed &= report(name + " accepts the proof", verifies(proto));
+
+            auto tampered = proto;
+            std::string proof = tampered.proof();
+            proof[proof.size() / 2] ^= 1;
+            tampered.set_proof(proof);
+            passed &= report(name + " rejects a tampered proof", !verifies(tampered));
+
+            Ciphertext<DCRTPoly> out;
+            std::istringstream iss(prover.output_bytes());
+            Serial::Deserialize(out, iss, SerType::BINARY);
+            auto cc = prover.GetCryptoContext();
+
+            auto claim = [&](const Ciphertext<DCRTPoly> &claimed)
+            {
+                auto other = proto;
+                std::ostringstream oss;
+                Serial::Serialize(claimed, oss, SerType::BINARY);
+                other.set_output(oss.str());
+                return other;
+            };
+            passed &= report(name + " rejects another output", !verifies(claim(cc->EvalAdd(out, out))));
+            // three elements instead of two
+            passed &= report(name + " rejects an output of another shape", !verifies(claim(cc->EvalMultNoRelin(out, out))));
+        }
+        return passed;
+    }
+
+    // the optimized constraint system and the concatenation of two of them against the conversion before the
+    // optimizer, all satisfied by the assignment of the computation and not by a tampered output
+    bool check_r1cs(const std::string &path)
+    {
+        std::ifstream ifs(path);
+        json c_json = json::parse(ifs);
+        ifs.close();
+
+        FHEComputer computer(c_json);
+        libiop::r1cs_primary_input<FieldT> primary;
+        libiop::r1cs_auxiliary_input<FieldT> aux;
+        auto circuit = computer.prove_circuit(primary, aux);
+        const auto &layout = computer.io_layout();
+        const auto &ls_cs = computer.ps_->pb.get_constraint_system();
+
+        libiop::r1cs_constraint_system<FieldT> plain_cs;
+        libsnark_to_libiop_r1cs_constraint_system(ls_cs, plain_cs, layout);
+        pad_constraint_system_for_aurora(plain_cs);
+        libiop::r1cs_primary_input<FieldT> plain_primary;
+        libiop::r1cs_auxiliary_input<FieldT> plain_aux;
+        split_assignment(computer.ps_->pb.full_variable_assignment(), layout, plain_primary, plain_aux);
+        pad_primary_input_to_match_cs(plain_cs, plain_primary);
+        pad_auxiliary_input_to_match_cs(plain_cs, plain_aux);
+
+        libiop::r1cs_constraint_system<FieldT> one_pass_cs;
+        libsnark_to_padded_libiop_r1cs_constraint_system(ls_cs, one_pass_cs, layout);
+
+        // two copies of the circuit side by side, assigned before the copies are padded
+        libiop::r1cs_constraint_system<FieldT> concat_cs;
+        R1CSPart<FieldT> part{&circuit->cs_, circuit->num_constraints_, circuit->num_inputs_, circuit->kept_aux_.size()};
+        concatenate_padded_r1cs_constraint_systems<FieldT>({part, part}, concat_cs);
+        auto concat_primary = primary;
+        concat_primary.insert(concat_primary.end(), primary.begin(), primary.end());
+        auto concat_aux = aux;
+        concat_aux.insert(concat_aux.end(), aux.begin(), aux.end());
+        pad_primary_input_to_match_cs(concat_cs, concat_primary);
+        pad_auxiliary_input_to_match_cs(concat_cs, concat_aux);
+
+        pad_primary_input_to_match_cs(circuit->cs_, primary);
+        pad_auxiliary_input_to_match_cs(circuit->cs_, aux);
+
+        cout << "unoptimized: " << plain_cs.num_constraints() << " constraints, " << plain_cs.num_variables() << " variables" << endl;
+        cout << "optimized:   " << circuit->num_constraints_ << " constraints, " << circuit->kept_aux_.size() << " auxiliary variables" << endl;
+
+        bool passed = true;
+        passed &= report("unoptimized system is satisfied", plain_cs.is_satisfied(plain_primary, plain_aux));
+        passed &= report("one pass conversion matches",
+                         one_pass_cs.num_constraints() == plain_cs.num_constraints() && one_pass_cs.num_inputs() == plain_cs.num_inputs() &&
+                             one_pass_cs.num_variables() == plain_cs.num_variables() && one_pass_cs.is_satisfied(plain_primary, plain_aux));
+        passed &= report("optimized system is satisfied", circuit->cs_.is_satisfied(primary, aux));
+        passed &= report("optimized public input matches", std::equal(primary.begin(), primary.begin() + circuit->num_inputs_, plain_primary.begin()));
+        passed &= report("concatenated system is satisfied", concat_cs.is_satisfied(concat_primary, concat_aux));
+
+        // the first output, right after the inputs
+        plain_primary[layout.num_inputs] += FieldT::one();
+        primary[layout.num_inputs] += FieldT::one();
+        concat_primary[circuit->num_inputs_ + layout.num_inputs] += FieldT::one();
+        passed &= report("unoptimized system rejects a tampered output", !plain_cs.is_satisfied(plain_primary, plain_aux));
+        passed &= report("optimized system rejects a tampered output", !circuit->cs_.is_satisfied(primary, aux));
+        passed &= report("concatenated system rejects a tampered output", !concat_cs.is_satisfied(concat_primary, concat_aux));
+        return passed;
+    }
+
+    std::vector<std::string> serialize_all(const std::vector<Ciphertext<DCRTPoly>> &ciphertexts)
+    {
+        std::vector<std::string> res;
+        for (const auto &c : ciphertexts)
+        {
+            std::ostringstream oss;
+            Serial::Serialize(c, oss, SerType::BINARY);
+            res.push_back(oss.str());
+        }
+        return res;
+    }
+
+    // binds with bind_inputs_to_data, encrypting concurrently, and with one encryption after another as it did
+    // before, which must give the same ciphertexts in every round
+    bool check_binding(const std::string &path, std::size_t rounds)
+    {
+        std::ifstream ifs(path);
+        json c_json = json::parse(ifs);
+        ifs.close();
+
+        // about the size of a serialized header
+        std::mt19937 rng(7);
+        std::vector<unsigned char> data(4096);
+        for (auto &b : data)
+        {
+            b = static_cast<unsigned char>(rng());
+        }
+        // not timed, the first encryptions set up OpenFHE
+        FHEComputation(c_json).bind_inputs_to_data(data);
+
+        FHEComputation serial(c_json);
+        auto cc = serial.GetCryptoContext();
+        std::vector<unsigned char> counter_and_data(sizeof(std::size_t) + data.size());
+        std::copy(data.begin(), data.end(), counter_and_data.begin() + sizeof(std::size_t));
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < serial.ciphertexts_.size(); ++i)
+        {
+            std::memcpy(counter_and_data.data(), &i, sizeof(std::size_t));
+            auto zero = cc->EncryptZeroDeterministic(serial.publicKey_, counter_and_data);
+            zero->SetKeyTag(serial.ciphertexts_[i]->GetKeyTag());
+            serial.ciphertexts_[i] = cc->EvalAdd(zero, serial.ciphertexts_[i]);
+        }
+        auto serial_ms = ms_since(start);
+        auto expected = serialize_all(serial.ciphertexts_);
+
+        bool matches = true;
+        double concurrent_ms = 0;
+        for (std::size_t r = 0; r < rounds; ++r)
+        {
+            FHEComputation concurrent(c_json);
+            start = std::chrono::steady_clock::now();
+            concurrent.bind_inputs_to_data(data);
+            concurrent_ms += ms_since(start);
+            if (serialize_all(concurrent.ciphertexts_) != expected)
+            {
+                cout << "MISMATCH in round " << r << endl;
+                matches = false;
+            }
+        }
+
+        cout << std::fixed << std::setprecision(3);
+        cout << expected.size() << " ciphertexts" << endl;
+        cout << "one after another (ms): " << serial_ms << endl;
+        cout << "concurrent (ms):        " << concurrent_ms / rounds << endl;
+        return report("concurrent binding matches", matches);
+    }
+
+    // compares evaluating and then constraining (two traversals) with the single traversal of generate_constraints
+    void bench_prove(const std::string &path)
+    {
+        std::ifstream ifs(path);
+        json c_json = json::parse(ifs);
+        ifs.close();
+
+        FHEComputer two_pass(c_json);
+        auto start = std::chrono::steady_clock::now();
+        two_pass.evaluate();
+        two_pass.generate_constraints(false);
+        auto two_pass_ms = ms_since(start);
+
+        FHEComputer one_pass(c_json);
+        start = std::chrono::steady_clock::now();
+        one_pass.generate_constraints(true);
+        auto one_pass_ms = ms_since(start);
+
+        cout << std::fixed << std::setprecision(3);
+        cout << "evaluate + constraints (ms): " << two_pass_ms << endl;
+        cout << "single pass (ms):            " << one_pass_ms << endl;
+    }
+
+    // proves and verifies the same constraint system with every backend
+    void bench_backends(const std::string &path)
+    {
+        std::ifstream ifs(path);
+        json c_json = json::parse(ifs);
+        ifs.close();
+
+        FHEComputer computer(c_json);
+        libiop::r1cs_primary_input<FieldT> primary;
+        libiop::r1cs_auxiliary_input<FieldT> aux;
+        auto circuit = computer.prove_circuit(primary, aux);
+        pad_primary_input_to_match_cs(circuit->cs_, primary);
+        pad_auxiliary_input_to_match_cs(circuit->cs_, aux);
+
+        std::vector<std::string> rows;
+        // Fractal indexes the shape while proving, so its verify time is the one of a recurring shape
+        for (auto type : {ProofBackendType::Aurora, ProofBackendType::Ligero, ProofBackendType::Fractal})
+        {
+            auto &backend = ProofBackend::get(type);
+
+            auto start = std::chrono::steady_clock::now();
+            auto proof = backend.prove(computer.shape_key(), circuit->cs_, primary, aux);
+            auto prove_ms = ms_since(start);
+
+            start = std::chrono::steady_clock::now();
+            bool valid = backend.verify(computer.shape_key(), circuit->cs_, primary, proof);
+            auto verify_ms = ms_since(start);
+
+            std::ostringstream row;
+            row << std::fixed << std::setprecision(3) << std::left << std::setw(10) << ProofBackend::name(type)
+                << std::setw(14) << prove_ms << std::setw(14) << verify_ms << std::setw(12) << proof.size() << std::boolalpha << valid;
+            rows.push_back(row.str());
+        }
+
+        // printed after both runs, so the table is not interleaved with the prover output
+        cout << circuit->cs_.num_constraints() << " constraints, " << circuit->cs_.num_variables() << " variables" << endl;
+        cout << std::left << std::setw(10) << "backend" << std::setw(14) << "prove(ms)" << std::setw(14) << "verify(ms)"
+             << std::setw(12) << "bytes" << "valid" << endl;
+        for (const auto &row : rows)
+        {
+            cout << row << endl;
+        }
+    }
+
+    // per-encryption cost of binding with a key deserialized and prepared each time, as before the
+    // public key cache, and with the cached one
+    void bench_keys(const std::string &path, std::size_t n)
+    {
+        std::ifstream ifs(path);
+        json c_json = json::parse(ifs);
+        ifs.close();
+
+        FHEComputation comp(c_json);
+        auto cc = comp.GetCryptoContext();
+        auto pubkey_str = base64::decode(c_json.at("public_key"));
+        std::vector<unsigned char> seed(sizeof(std::size_t) + 80, 0);
+
+        auto start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(seed.data(), &i, sizeof(std::size_t));
+            std::istringstream iss(pubkey_str);
+            PublicKey<DCRTPoly> key;
+            Serial::Deserialize(key, iss, SerType::BINARY);
+            cc->EncryptZeroDeterministic(key, seed);
+        }
+        auto cold_ms = ms_since(start) / n;
+
+        start = std::chrono::steady_clock::now();
+        for (std::size_t i = 0; i < n; ++i)
+        {
+            std::memcpy(seed.data(), &i, sizeof(std::size_t));
+            cc->EncryptZeroDeterministic(PublicKeyCache::instance().get(pubkey_str)->key_, seed);
+        }
+        auto cached_ms = ms_since(start) / n;
+
+        cout << std::fixed << std::setprecision(3);
+        cout << "public key: " << pubkey_str.size() << " bytes, " << n << " encryptions of zero" << endl;
+        cout << "uncached (ms/encryption): " << cold_ms << endl;
+        cout << "cached (ms/encryption):   " << cached_ms << endl;
+        cout << "saving (ms/encryption):   " << cold_ms - cached_ms << endl;
+    }
+
+    // least squares y = a + b * x over (x, y) points, through the origin when the points cannot tell
+    // the intercept or give a negative one
+    std::pair<double, double> fit_line(const std::vector<std::pair<double, double>> &points)
+    {
+        double n = points.size(), sx = 0, sy = 0, sxx = 0, sxy = 0;
+        for (const auto &[x, y] : points)
+        {
+            sx += x;
+            sy += y;
+            sxx += x * x;
+            sxy += x * y;
+        }
+
+        double denom = n * sxx - sx * sx;
+        if (points.size() > 1 && denom > 1e-9 * n * sxx)
+        {
+            double b = (n * sxy - sx * sy) / denom;
+            double a = (sy - b * sx) / n;
+            if (a >= 0 && b >= 0)
+            {
+                return {a, b};
+            }
+        }
+        return {0, (sxx > 0) ? sxy / sxx : 0};
+    }
+
+    // non-negative least squares weights of the units of every sample to its constraints, by coordinate
+    // descent. Kinds no sample exercises keep their initial weight
+    std::map<std::string, double> fit_weights(const std::vector<std::pair<CostModel::Units, double>> &samples, std::map<std::string, double> weights)
+    {
+        std::map<std::string, double> norms;
+        for (const auto &[units, constraints] : samples)
+        {
+            for (const auto &[kind, u] : units)
+            {
+                norms[kind] += u * u;
+            }
+        }
+
+        for (int round = 0; round < 1000; ++round)
+        {
+            double moved = 0;
+            for (const auto &kind : CostModel::kinds())
+            {
+                if (norms[kind] <= 0)
+                {
+                    continue;
+                }
+                // residual without this kind, projected on it
+                double dot = 0;
+                for (const auto &[units, constraints] : samples)
+                {
+                    double predicted = 0;
+                    for (const auto &[other, u] : units)
+                    {
+                        predicted += (other == kind) ? 0 : weights[other] * u;
+                    }
+                    dot += units.at(kind) * (constraints - predicted);
+                }
+                double w = std::max(0.0, dot / norms[kind]);
+                moved = std::max(moved, std::abs(w - weights[kind]) / std::max(w, 1e-12));
+                weights[kind] = w;
+            }
+            if (moved < 1e-9)
+            {
+                break;
+            }
+        }
+        return weights;
+    }
+
+    // proves the computations with every backend and fits the cost model to the measured sizes and times:
+    // the weight of every kind of operation, the variables per constraint and the backend coefficients.
+    // Prints the calibrated config["proof"]["cost_model"]. Samples of varied operations and levels pin the
+    // weights down, with fewer samples than kinds of operations the fit is underdetermined
+    void bench_cost(const std::vector<std::string> &paths)
+    {
+        CostModel uncalibrated;
+        auto initial = uncalibrated.config()["weights"].get<std::map<std::string, double>>();
+        std::vector<std::pair<CostModel::Units, double>> samples;
+        double variables_sum = 0;
+        std::map<ProofBackendType, std::vector<std::pair<double, double>>> prove_points, verify_points;
+
+        std::vector<std::string> rows;
+        for (const auto &path : paths)
+        {
+            std::ifstream ifs(path);
+            json c_json = json::parse(ifs);
+            ifs.close();
+
+            FHEComputer computer(c_json);
+            auto predicted = uncalibrated.estimate(computer.ast_->program_, computer.GetCryptoContext(), computer.computation_->ciphertexts_);
+            auto units = CostModel::units(computer.ast_->program_, computer.GetCryptoContext(), computer.computation_->ciphertexts_);
+
+            libiop::r1cs_primary_input<FieldT> primary;
+            libiop::r1cs_auxiliary_input<FieldT> aux;
+            auto circuit = computer.prove_circuit(primary, aux);
+            double constraints = circuit->num_constraints_;
+            double variables = primary.size() + aux.size();
+            samples.emplace_back(units, constraints);
+            variables_sum += variables / constraints;
+
+            pad_primary_input_to_match_cs(circuit->cs_, primary);
+            pad_auxiliary_input_to_match_cs(circuit->cs_, aux);
+            double padded = circuit->cs_.num_constraints();
+
+            std::ostringstream row;
+            row << std::fixed << std::setprecision(3) << std::left << std::setw(32) << path << std::setw(14) << predicted.constraints
+                << std::setw(14) << static_cast<uint64_t>(constraints);
+            for (auto type : {ProofBackendType::Aurora, ProofBackendType::Ligero, ProofBackendType::Fractal})
+            {
+                auto &backend = ProofBackend::get(type);
+
+                auto start = std::chrono::steady_clock::now();
+                auto proof = backend.prove(computer.shape_key(), circuit->cs_, primary, aux);
+                auto prove_s = ms_since(start) / 1000;
+
+                start = std::chrono::steady_clock::now();
+                backend.verify(computer.shape_key(), circuit->cs_, primary, proof);
+                auto verify_s = ms_since(start) / 1000;
+
+                prove_points[type].emplace_back(padded * std::log2(padded), prove_s);
+                verify_points[type].emplace_back(padded, verify_s);
+                row << std::setw(10) << prove_s << std::setw(10) << verify_s;
+            }
+            rows.push_back(row.str());
+        }
+
+        CostModel calibrated;
+        json backends = json::object();
+        for (const auto &[type, points] : prove_points)
+        {
+            auto [prove_fixed, prove] = fit_line(points);
+            auto [verify_fixed, verify] = fit_line(verify_points[type]);
+            backends[ProofBackend::name(type)] = {{"prove_fixed_s", prove_fixed}, {"prove_s", prove}, {"verify_fixed_s", verify_fixed}, {"verify_s", verify}};
+        }
+        calibrated.configure({{"weights", fit_weights(samples, initial)}, {"variables_per_constraint", variables_sum / paths.size()}, {"backends", backends}});
+
+        // printed after all runs, so the table is not interleaved with the prover output
+        cout << std::left << std::setw(32) << "computation" << std::setw(14) << "default" << std::setw(14) << "constraints"
+             << std::setw(20) << "aurora prove/verify" << std::setw(20) << "ligero (s)" << "fractal (s)" << endl;
+        for (const auto &row : rows)
+        {
+            cout << row << endl;
+        }
+        cout << "cost_model: " << calibrated.config().dump(4) << endl;
+    }
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        std::cerr << "Usage: " << argv[0] << " ast [max_operands]" << endl;
+        std::cerr << "       " << argv[0] << " prove <computation.json>" << endl;
+        std::cerr << "       " << argv[0] << " backends <computation.json>" << endl;
+        std::cerr << "       " << argv[0] << " keys <computation.json> [encryptions]" << endl;
+        std::cerr << "       " << argv[0] << " cost <computation.json>..." << endl;
+        std::cerr << "       " << argv[0] << " check ast [expressions]" << endl;
+        std::cerr << "       " << argv[0] << " check proofs <computation.json>" << endl;
+        std::cerr << "       " << argv[0] << " check r1cs <computation.json>" << endl;
+        std::cerr << "       " << argv[0] << " check binding <computation.json> [rounds]" << endl;
+        return 1;
+    }
+
+    std::string cmd(argv[1]);
+    if (cmd == "ast")
+    {
+        std::size_t max_operands = (argc > 2) ? std::strtoull(argv[2], nullptr, 10) : 1000000;
+        bench_ast(max_operands);
+        return 0;
+    }
+
+    if (cmd == "prove" && argc > 2)
+    {
+        bench_prove(argv[2]);
+        return 0;
+    }
+
+    if (cmd == "backends" && argc > 2)
+    {
+        bench_backends(argv[2]);
+        return 0;
+    }
+
+    if (cmd == "keys" && argc > 2)
+    {
+        std::size_t n = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 100;
+        bench_keys(argv[2], std::max<std::size_t>(n, 1));
+        return 0;
+    }
+
+    if (cmd == "cost" && argc > 2)
+    {
+        bench_cost(std::vector<std::string>(argv + 2, argv + argc));
+        return 0;
+    }
+
+    if (cmd == "check" && argc > 2 && std::string(argv[2]) == "ast")
+    {
+        std::size_t n = (argc > 3) ? std::strtoull(argv[3], nullptr, 10) : 2000;
+        return check_ast(n) ? 0 : 1;
+    }
+
+    if (cmd == "check" && argc > 3 && std::string(argv[2]) == "proofs")
+    {
+        return check_proofs(argv[3]) ? 0 : 1;
+    }
+
+    if (cmd == "check" && argc > 3 && std::string(argv[2]) == "r1cs")
+    {
+        return check_r1cs(argv[3]) ? 0 : 1;
+    }
+
+    if (cmd == "check" && argc > 3 && std::string(argv[2]) == "binding")
+    {
+        std::size_t rounds = (argc > 4) ? std::strtoull(argv[4], nullptr, 10) : 10;
+        return check_binding(argv[3], std::max<std::size_t>(rounds, 1)) ? 0 : 1;
+    }
+
+    std::cerr << "Unknown benchmark: " << cmd << endl;
+    return 1;
+}
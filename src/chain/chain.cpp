@@ -1,17 +1,35 @@
 #include "chain/chain.hpp"
 #include "util/util.hpp"
+#include "util/thread_pool.hpp"
 #include "core/merkle.hpp"
 
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
 #include "base64.hpp"
 
 #include <cmath>
+#include <algorithm>
+#include <exception>
 #include <iostream>
 #include <ctime>
 
 #include <unordered_set>
 
-Chain::Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store)
-    : config_(config), total_difficulty_(0), chainstate_(chainstate), block_store_(block_store), mem_pool_(mem_pool), comp_store_(comp_store)
+namespace
+{
+    // threads shared by the proofs verified at once, 0 uses every hardware thread
+    std::size_t thread_budget(const json &config)
+    {
+        std::size_t budget = config.contains("proof") ? config["proof"].value("thread_budget", std::size_t(0)) : 0;
+        return (budget == 0) ? std::max(1u, std::thread::hardware_concurrency()) : budget;
+    }
+}
+
+Chain::Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store,
+             std::shared_ptr<ProofAggregator> aggregator)
+    : config_(config), total_difficulty_(0), chainstate_(chainstate), block_store_(block_store), mem_pool_(mem_pool), comp_store_(comp_store), aggregator_(aggregator)
 {
     auto genesis = create_genesis();
     block_store->store_block(genesis->hash(), genesis);
@@ -20,8 +38,9 @@ Chain::Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::s
     total_difficulty_ += genesis->header_->difficulty_;
 }
 
-Chain::Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<ICompStore> comp_store, bool is_fork)
-    : config_(config), total_difficulty_(0), chainstate_(chainstate), block_store_(block_store), comp_store_(comp_store)
+Chain::Chain(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store, std::shared_ptr<ICompStore> comp_store,
+             std::shared_ptr<ProofAggregator> aggregator, bool is_fork)
+    : config_(config), total_difficulty_(0), chainstate_(chainstate), block_store_(block_store), comp_store_(comp_store), aggregator_(aggregator)
 {
 }
 
@@ -200,24 +219,113 @@ bool Chain::validate_header_unsafe(std::shared_ptr<BlockHeader> header, uint32_t
     // TODO: think about deserialization and if loaded computation is bound or not
 
     // Binding data will be:
+    // - Serialized Header without the proofs (computations included not bound yet), or its digest
     // - Index of computation in computation vector (8 bytes)
-    // - Serialized Header without the proofs (computations included not bound yet)
+    if (header->binding_version_ > BINDING_HEADER_DIGEST)
+    {
+        std::cout << "Unknown binding version." << std::endl;
+        return false;
+    }
+
+    const auto hser = header->binding_prefix();
+    // with a block proof, the computations are checked together once all of them are bound
+    bool verify_each = header->block_proof_.empty();
 
-    uint64_t idx = 0;
-    auto hser_all = header->serialize(false);
+    // every computation is bound and verified on its own on the validation pool. The first invalid proof
+    // stops the rest: computations not started are skipped, running ones stop at their next constraint
+    // through the stop flag
+    auto invalid = std::make_shared<std::atomic<bool>>(false);
+    std::vector<std::shared_ptr<std::atomic<bool>>> previous_flags;
+    previous_flags.reserve(header->computations_.size());
     for (const auto &comp : header->computations_)
     {
-        // serialize header without proofs
-        std::vector<unsigned char> hser(hser_all);
-        // append computation idx
-        auto idxser = util::uint64_to_vector_big_endian(idx++);
-        hser.insert(hser.end(), idxser.begin(), idxser.end());
-
-        // bind computation to this data
-        comp->bind_to_data(hser);
-        if (!(comp->verify_proof(comp->proof())))
+        // the computations may be shared with the miner, which waits on its own flag
+        previous_flags.push_back(comp->stop_flag());
+    }
+
+    auto &pool = ThreadPool::validation();
+    // concurrent proofs split the thread budget among the OpenMP regions of libiop, as the miner does
+    auto concurrent = std::max<std::size_t>(1, std::min(header->computations_.size(), pool.size()));
+    int omp_threads = static_cast<int>(std::max<std::size_t>(1, thread_budget(config_) / concurrent));
+
+    // the wait helps with pending tasks instead of blocking, so validating from a validation worker cannot
+    // run out of workers
+    TaskGroup group(pool);
+    for (uint64_t idx = 0; idx < header->computations_.size(); ++idx)
+    {
+        auto comp = header->computations_[idx];
+        group.run([&hser, comp, idx, invalid, verify_each, omp_threads]()
+                  {
+            if (*invalid)
+            {
+                return;
+            }
+#ifdef MULTICORE
+            omp_set_num_threads(omp_threads);
+#endif
+
+            try
+            {
+                // append computation idx
+                auto data = hser;
+                data.resize(hser.size() + sizeof(uint64_t));
+                util::uint64_to_uchar_big_endian(idx, data.data() + hser.size());
+
+                // bind computation to this data
+                comp->set_stop_flag(invalid);
+                comp->bind_to_data(data);
+                if (!verify_each || comp->verify_proof(comp->proof()))
+                {
+                    return;
+                }
+                std::cout << "Computation proof not valid." << std::endl;
+            }
+            catch (...)
+            {
+                // stopped by another invalid proof
+                if (*invalid)
+                {
+                    return;
+                }
+                *invalid = true;
+                throw;
+            }
+            *invalid = true; });
+    }
+
+    // every task refers to this frame, wait returns only once all of them are done
+    std::exception_ptr error;
+    try
+    {
+        group.wait();
+    }
+    catch (...)
+    {
+        error = std::current_exception();
+    }
+    for (std::size_t i = 0; i < header->computations_.size(); ++i)
+    {
+        header->computations_[i]->set_stop_flag(previous_flags[i]);
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    if (*invalid)
+    {
+        return false;
+    }
+
+    if (!header->block_proof_.empty())
+    {
+        if (!aggregator_)
+        {
+            std::cout << "Block proofs are not supported." << std::endl;
+            return false;
+        }
+        if (!aggregator_->verify(header->computations_, header->block_proof_))
         {
-            std::cout << "Computation proof not valid." << std::endl;
+            std::cout << "Block proof not valid." << std::endl;
             return false;
         }
     }
@@ -4,12 +4,42 @@
 
 #include "util/util.hpp"
 
+namespace
+{
+    // blocks mined here carry a block proof only if enabled, blocks from peers are accepted either way
+    bool block_proof_enabled(const json &config)
+    {
+        return config.contains("proof") && config["proof"].value("block_proof", false);
+    }
+
+    // blocks from peers are accepted with any known binding version
+    uint32_t binding_version(const json &config)
+    {
+        return config.at("chain").value("binding_version", BINDING_FULL_HEADER);
+    }
+
+    // computations of a mined block proven concurrently, and the threads they share
+    std::size_t prover_workers(const json &config)
+    {
+        return config.contains("proof") ? config["proof"].value("prover_workers", std::size_t(1)) : 1;
+    }
+
+    std::size_t thread_budget(const json &config)
+    {
+        return config.contains("proof") ? config["proof"].value("thread_budget", std::size_t(0)) : 0;
+    }
+}
+
 ChainManager::ChainManager(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> blockstore,
                            std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store,
-                           std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<Wallet> wallet)
+                           std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<Wallet> wallet,
+                           std::shared_ptr<ProofAggregator> aggregator)
     : config_(config), chainstate_(chainstate), block_store_(blockstore), mem_pool_(mem_pool),
-      comp_store_(comp_store), miner_(std::make_unique<Miner>(stop_flag, mem_pool, comp_store)), wallet_(wallet),
-      main_chain_(std::make_unique<Chain>(config, chainstate, blockstore, mem_pool, comp_store))
+      comp_store_(comp_store), aggregator_(aggregator),
+      miner_(std::make_unique<Miner>(stop_flag, mem_pool, comp_store, block_proof_enabled(config) ? aggregator : nullptr,
+                                     binding_version(config), prover_workers(config), thread_budget(config))),
+      wallet_(wallet),
+      main_chain_(std::make_unique<Chain>(config, chainstate, blockstore, mem_pool, comp_store, aggregator))
 {
 }
 
@@ -77,7 +107,7 @@ bool ChainManager::add_block(std::shared_ptr<Block> block, bool is_main_and_vali
         if (block->header_->prev_hash() == main_chain_->header_chain_[i]->hash())
         {
             // found new point
-            auto new_fork = std::make_shared<Fork>(config_, chainstate_, block_store_, comp_store_, i, main_chain_->header_chain_[i], total_diff);
+            auto new_fork = std::make_shared<Fork>(config_, chainstate_, block_store_, comp_store_, aggregator_, i, main_chain_->header_chain_[i], total_diff);
             if (!new_fork->append_block(block))
             {
                 // found attachment point for new fork, but block header was invalid
@@ -96,7 +126,7 @@ void ChainManager::reorg(std::shared_ptr<Fork> fork)
 {
     // already locked, re-org is called from append
 
-    auto old_main_fork = std::make_shared<Fork>(config_, chainstate_, block_store_, comp_store_, fork->chain_src_, main_chain_->header_chain_[fork->chain_src_], main_chain_->total_difficulty_);
+    auto old_main_fork = std::make_shared<Fork>(config_, chainstate_, block_store_, comp_store_, aggregator_, fork->chain_src_, main_chain_->header_chain_[fork->chain_src_], main_chain_->total_difficulty_);
     for (uint64_t i = fork->chain_src_ + 1; i < main_chain_->size(); ++i)
     {
         // directly insert in chain, since we know everything else is valid with this chain
@@ -2,8 +2,8 @@
 #include "util/util.hpp"
 #include <iostream>
 
-Fork::Fork(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store,std::shared_ptr<ICompStore> comp_store, uint32_t chain_src, std::shared_ptr<BlockHeader> chain_src_header, uint64_t diff)
-    : Chain(config, chainstate, block_store, comp_store, true), config_(config), chain_src_(chain_src), chain_src_header_(chain_src_header)
+Fork::Fork(const json &config, std::shared_ptr<IChainstate> chainstate, std::shared_ptr<IBlockStore> block_store,std::shared_ptr<ICompStore> comp_store, std::shared_ptr<ProofAggregator> aggregator, uint32_t chain_src, std::shared_ptr<BlockHeader> chain_src_header, uint64_t diff)
+    : Chain(config, chainstate, block_store, comp_store, aggregator, true), config_(config), chain_src_(chain_src), chain_src_header_(chain_src_header)
 {
     total_difficulty_ = diff;
 }
@@ -5,12 +5,21 @@
 
 #include <iostream>
 #include <ctime>
+#include <exception>
+#include <future>
 #include <thread>
 
+#ifdef MULTICORE
+#include <omp.h>
+#endif
+
 #include "base64.hpp"
 
-Miner::Miner(std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store)
-    : have_result_(false), result(nullptr), stop_flag_(stop_flag), mem_pool_(mem_pool), comp_store_(comp_store)
+Miner::Miner(std::shared_ptr<std::atomic<bool>> stop_flag, std::shared_ptr<IMemPool> mem_pool, std::shared_ptr<ICompStore> comp_store,
+             std::shared_ptr<ProofAggregator> aggregator, uint32_t binding_version, std::size_t prover_workers, std::size_t thread_budget)
+    : have_result_(false), result(nullptr), stop_flag_(stop_flag), mem_pool_(mem_pool), comp_store_(comp_store), aggregator_(aggregator),
+      binding_version_(binding_version), prover_pool_(std::make_unique<ThreadPool>(prover_workers)),
+      thread_budget_((thread_budget == 0) ? std::max(1u, std::thread::hardware_concurrency()) : thread_budget)
 {
 }
 
@@ -36,29 +45,99 @@ void Miner::mine(std::shared_ptr<BlockHeader> prev_header, uint32_t height, uint
     // NOTE: maybe this block is initialized with an old cached hash of the previous block header
     auto new_block = std::make_shared<Block>(prev_header, difficulty, comps, txs_with_cb);
 
-    // Computation is bound to the serialized header + the index of the computation in the vector
+    // Computation is bound to the serialized header, or its digest, + the index of the computation in the vector
 
     // bind computations and generate proofs
-    uint64_t idx = 0;
-    auto hser_all = new_block->header_->serialize(false);
-    for (const auto &comp : new_block->header_->computations_)
+    new_block->header_->binding_version_ = binding_version_;
+    // serialize header without proofs, or its digest
+    const auto hser = new_block->header_->binding_prefix();
+    const auto &block_comps = new_block->header_->computations_;
+
+    // every computation is bound and proven on its own on the prover pool, so the block waits for the slowest
+    // proof instead of the sum. libiop runs OpenMP regions inside every proof, the thread budget is split
+    // among the concurrent ones
+    std::size_t concurrent = std::max<std::size_t>(1, std::min(block_comps.size(), prover_pool_->size()));
+    int omp_threads = static_cast<int>(std::max<std::size_t>(1, thread_budget_ / concurrent));
+
+    // set by the first failure, so the computations not started yet are skipped
+    std::atomic<bool> failed(false);
+    std::vector<std::future<void>> done;
+    done.reserve(block_comps.size());
+    for (uint64_t idx = 0; idx < block_comps.size(); ++idx)
+    {
+        auto comp = block_comps[idx];
+        auto task = std::make_shared<std::packaged_task<void()>>([this, &hser, &failed, comp, idx, omp_threads]()
+                                                                 {
+            try
+            {
+                if (failed || *stop_flag_)
+                {
+                    throw std::out_of_range("stop flag");
+                }
+#ifdef MULTICORE
+                omp_set_num_threads(omp_threads);
+#endif
+                // append computation idx
+                auto data = hser;
+                data.resize(hser.size() + sizeof(uint64_t));
+                util::uint64_to_uchar_big_endian(idx, data.data() + hser.size());
+
+                // bind computation to this data
+                comp->set_stop_flag(stop_flag_);
+                // binding spreads over the compute pool, but no wider than the OpenMP threads set above
+                comp->bind_to_data(data);
+
+                // with an aggregator, proven together once all of them are bound
+                if (!aggregator_)
+                {
+                    comp->generate_proof();
+                }
+            }
+            catch (...)
+            {
+                failed = true;
+                throw;
+            } });
+        done.push_back(task->get_future());
+        prover_pool_->submit([task]()
+                             { (*task)(); });
+    }
+
+    // every task refers to this frame, so all of them are waited for before leaving
+    bool stopped = false;
+    std::exception_ptr error;
+    for (auto &f : done)
+    {
+        try
+        {
+            f.get();
+        }
+        catch (std::out_of_range &exc)
+        {
+            stopped = true;
+        }
+        catch (...)
+        {
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+        }
+    }
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+    if (stopped)
+    {
+        return;
+    }
+
+    if (aggregator_)
     {
-        std::vector<unsigned char> hser(hser_all);
-        // serialize header without proofs
-        // append computation idx
-        auto idxser = util::uint64_to_vector_big_endian(idx++);
-        hser.insert(hser.end(), idxser.begin(), idxser.end());
-
-        // bind computation to this data
-        comp->set_stop_flag(stop_flag_);
-        std::cout << "inside miner, binding comp with idx: " << idx - 1 << "with data hash:" << std::endl;
-        unsigned char digest[64];
-        crypto_generichash(digest, 64, hser.data(), hser.size(), nullptr, 0);
-        std::cout << base64::encode(digest, 64) << std::endl;
-        comp->bind_to_data(hser);
         try
         {
-            comp->generate_proof();
+            new_block->header_->block_proof_ = aggregator_->prove(new_block->header_->computations_);
         }
         catch (std::out_of_range &exc)
         {
@@ -1,268 +1,762 @@
 #include <iostream>
 #include "computer/ast.hpp"
 #include <stack>
+#include <deque>
+#include <cctype>
 #include <unordered_map>
+#include <tuple>
+#include <algorithm>
+#include <map>
+#include <stdexcept>
+#include <queue>
 
-ASTNode::ASTNode(int id, bool counts_for_depth, std::shared_ptr<ASTNode> parent, std::string op) : is_leaf(false), val_(0), node_id_(id), parent_(parent), left_child_(nullptr), right_child_(nullptr), op_(op), counts_for_depth_(counts_for_depth)
+bool ASTNode::is_leaf() const
 {
-    if (counts_for_depth)
-    {
-        depth_ = 1;
-    }
-    else
-    {
-        depth_ = 0;
-    }
+    return op_ == ASTOp::Leaf || op_ == ASTOp::Const;
+}
+
+bool ASTNode::is_const() const
+{
+    return op_ == ASTOp::Const;
+}
+
+bool ASTNode::counts_for_depth() const
+{
+    return op_ == ASTOp::Mul;
+}
+
+bool ASTNode::is_full() const
+{
+    return right_child_ != AST_NONE && left_child_ != AST_NONE;
+}
+
+ASTree::ASTree(const std::string &expression, bool cse) : root_(AST_NONE), schedule_report_(), input_(shunt(expression)), is_scheduled_(false)
+{
+    build_tree();
+    rebalance();
+    compile(cse);
 }
 
-ASTNode::ASTNode(int id, int val, std::shared_ptr<ASTNode> parent) : is_leaf(true), val_(val), node_id_(id), parent_(parent), left_child_(nullptr), right_child_(nullptr), depth_(0), counts_for_depth_(false)
+ASTree::ASTree(const std::vector<ASTToken> &postfix, bool cse) : root_(AST_NONE), schedule_report_(), input_(postfix), is_scheduled_(false)
 {
+    build_tree();
+    rebalance();
+    compile(cse);
 }
 
-bool ASTNode::is_full()
+uint32_t ASTree::add_node(ASTOp op, int32_t val)
 {
-    return right_child_ && left_child_;
+    ASTNode node;
+    node.parent_ = AST_NONE;
+    node.left_child_ = AST_NONE;
+    node.right_child_ = AST_NONE;
+    node.val_ = val;
+    node.op_ = op;
+    node.depth_ = node.counts_for_depth() ? 1 : 0;
+
+    nodes_.push_back(node);
+    return nodes_.size() - 1;
 }
 
-void ASTNode::notify_child_change(std::shared_ptr<ASTNode> new_child, int old_child_id)
+void ASTree::notify_child_change(uint32_t node, uint32_t new_child, uint32_t old_child)
 {
-    if (right_child_ && right_child_->node_id_ == old_child_id)
+    auto &n = nodes_[node];
+    if (n.right_child_ == old_child)
     {
-        right_child_ = new_child;
+        n.right_child_ = new_child;
     }
-    else if (left_child_ && left_child_->node_id_ == old_child_id)
+    else if (n.left_child_ == old_child)
     {
-        left_child_ = new_child;
+        n.left_child_ = new_child;
     }
 }
 
-bool ASTNode::insert_child(std::shared_ptr<ASTNode> child)
+int ASTree::get_depth(uint32_t node)
 {
-    // priority will be to insert to the right
-    if (!right_child_)
+    if (node == AST_NONE)
     {
-        right_child_ = child;
-        return false;
+        return 0;
     }
-    left_child_ = child;
-    return true;
+
+    return nodes_[node].depth_;
 }
 
-bool ASTNode::can_rotate_left()
+int ASTree::depth() const
 {
-    // for left rotation, this node needs to be "*" and right child too
-    return (right_child_ && right_child_->op_ == "*" && op_ == "*");
+    return program_.back().depth_;
 }
 
-bool ASTNode::can_rotate_right()
+void ASTree::build_tree()
 {
-    // for right rotation, this node needs to be "*" and left child too
-    return (left_child_ && left_child_->op_ == "*" && op_ == "*");
+    nodes_.reserve(input_.size());
+
+    // input is in postfix order, so the operands of an operator are complete subtrees on top of the stack
+    std::vector<uint32_t> operands;
+    for (const auto &token : input_)
+    {
+        auto new_node = add_node(token.op_, token.val_);
+
+        if (token.op_ == ASTOp::Pow)
+        {
+            if (operands.empty())
+            {
+                throw std::invalid_argument("Invalid expression syntax: missing operand.");
+            }
+            if (token.val_ < 1)
+            {
+                throw std::invalid_argument("Invalid expression syntax: exponent must be positive.");
+            }
+            auto base = operands.back();
+            nodes_[new_node].left_child_ = base;
+            nodes_[base].parent_ = new_node;
+            operands.back() = new_node;
+            continue;
+        }
+
+        if (!nodes_[new_node].is_leaf())
+        {
+            if (operands.size() < 2)
+            {
+                throw std::invalid_argument("Invalid expression syntax: missing operand.");
+            }
+            auto right = operands.back();
+            operands.pop_back();
+            auto left = operands.back();
+            operands.pop_back();
+
+            nodes_[new_node].left_child_ = left;
+            nodes_[new_node].right_child_ = right;
+            nodes_[left].parent_ = new_node;
+            nodes_[right].parent_ = new_node;
+        }
+        operands.push_back(new_node);
+    }
+
+    if (operands.size() != 1)
+    {
+        throw std::invalid_argument("Invalid expression syntax: missing operator.");
+    }
+    // root parent is left empty
+    root_ = operands.back();
 }
 
-ASTree::ASTree(const std::string &expression) : node_counter_(0), root_(nullptr), input_(shunt(expression))
+bool ASTree::same_chain(uint32_t a, uint32_t b) const
 {
-    build_tree();
+    // + and - can be regrouped with each other, * only with itself. A power is an operand of its chain
+    auto op_a = nodes_[a].op_;
+    auto op_b = nodes_[b].op_;
+    if (op_a == ASTOp::Mul || op_b == ASTOp::Mul)
+    {
+        return op_a == op_b;
+    }
+    auto is_sum = [](ASTOp op)
+    {
+        return op == ASTOp::Add || op == ASTOp::Sub;
+    };
+    return is_sum(op_a) && is_sum(op_b);
 }
 
-ASTree::ASTree(const std::deque<std::string> &input) : node_counter_(0), root_(nullptr), input_(input)
+int32_t ASTree::pow_depth(int32_t exponent)
 {
-    build_tree();
+    // the square for bit i is at depth i, the squares of the set bits are then merged shallowest first,
+    // as compile does
+    std::priority_queue<int32_t, std::vector<int32_t>, std::greater<int32_t>> factors;
+    for (int32_t bit = 0; (exponent >> bit) != 0; ++bit)
+    {
+        if ((exponent >> bit) & 1)
+        {
+            factors.push(bit);
+        }
+    }
+    while (factors.size() > 1)
+    {
+        auto a = factors.top();
+        factors.pop();
+        auto b = factors.top();
+        factors.pop();
+        factors.push(std::max(a, b) + 1);
+    }
+    return factors.top();
 }
 
-int ASTree::get_depth(std::shared_ptr<ASTNode> node)
+void ASTree::rebalance()
 {
-    if (!node)
+    // post order of the parsed tree, so the operands of a chain are final when the chain is rebuilt
+    std::vector<uint32_t> order;
+    order.reserve(nodes_.size());
+    std::stack<std::pair<uint32_t, bool>> to_visit;
+    to_visit.push({root_, false});
+    while (!to_visit.empty())
     {
-        return 0;
+        auto [node, expanded] = to_visit.top();
+        to_visit.pop();
+        const auto &n = nodes_[node];
+        if (n.op_ == ASTOp::Pow && !expanded)
+        {
+            to_visit.push({node, true});
+            to_visit.push({n.left_child_, false});
+            continue;
+        }
+        if (!n.is_leaf() && !expanded)
+        {
+            if (n.left_child_ == AST_NONE || n.right_child_ == AST_NONE)
+            {
+                throw std::runtime_error("Internal ASTNode should have both chldren.");
+            }
+            to_visit.push({node, true});
+            to_visit.push({n.right_child_, false});
+            to_visit.push({n.left_child_, false});
+            continue;
+        }
+        order.push_back(node);
     }
 
-    return node->depth_;
+    std::vector<int32_t> height(nodes_.size(), 0);
+    for (auto node : order)
+    {
+        if (nodes_[node].is_leaf())
+        {
+            nodes_[node].depth_ = 0;
+            continue;
+        }
+
+        if (nodes_[node].op_ == ASTOp::Pow)
+        {
+            rebuild_pow(node, height);
+            continue;
+        }
+
+        auto parent = nodes_[node].parent_;
+        if (parent != AST_NONE && same_chain(parent, node))
+        {
+            // inner node of a chain, rebuilt together with the top of the chain
+            continue;
+        }
+
+        auto new_root = rebuild_chain(node, height);
+        nodes_[new_root].parent_ = parent;
+        if (parent == AST_NONE)
+        {
+            root_ = new_root;
+        }
+        else
+        {
+            notify_child_change(parent, new_root, node);
+        }
+    }
 }
 
-int ASTree::get_balance(std::shared_ptr<ASTNode> node)
+uint32_t ASTree::rebuild_chain(uint32_t chain_root, std::vector<int32_t> &height)
 {
-    if (!node)
+    struct Term
     {
-        return 0;
+        uint32_t node;
+        bool negative;
+        int32_t depth;
+        int32_t height;
+        uint32_t seq;
+    };
+
+    bool is_product = nodes_[chain_root].op_ == ASTOp::Mul;
+
+    // collect the operands of the chain left to right, with the sign they have in the flattened sum.
+    // Constants are folded into a single one instead
+    std::vector<Term> terms;
+    std::vector<uint32_t> free_nodes;
+    bool has_const = false;
+    int64_t folded = is_product ? 1 : 0;
+    std::stack<std::pair<uint32_t, bool>> to_visit;
+    to_visit.push({chain_root, false});
+    while (!to_visit.empty())
+    {
+        auto [node, negative] = to_visit.top();
+        to_visit.pop();
+        const auto &n = nodes_[node];
+
+        if (node != chain_root && n.is_const())
+        {
+            has_const = true;
+            int64_t val = negative ? -static_cast<int64_t>(n.val_) : n.val_;
+            bool overflow = is_product ? __builtin_mul_overflow(folded, val, &folded) : __builtin_add_overflow(folded, val, &folded);
+            if (overflow)
+            {
+                throw std::out_of_range("Invalid expression syntax: constant too large.");
+            }
+            continue;
+        }
+        if (node != chain_root && !same_chain(chain_root, node))
+        {
+            terms.push_back({node, negative, n.depth_, height[node], static_cast<uint32_t>(terms.size())});
+            continue;
+        }
+
+        // the internal nodes of the chain are reused for the rebuilt one
+        free_nodes.push_back(node);
+        to_visit.push({n.right_child_, (n.op_ == ASTOp::Sub) ? !negative : negative});
+        to_visit.push({n.left_child_, negative});
     }
 
-    return get_depth(node->left_child_) - get_depth(node->right_child_);
-}
+    if (has_const && (folded < INT32_MIN || folded > INT32_MAX))
+    {
+        throw std::out_of_range("Invalid expression syntax: constant too large.");
+    }
 
-std::shared_ptr<ASTNode> ASTree::right_rotate(std::shared_ptr<ASTNode> node)
-{
-    auto x = node->left_child_;
-    auto x_r = x->right_child_;
+    if (terms.empty())
+    {
+        // the whole chain is constant
+        auto &n = nodes_[chain_root];
+        n.op_ = ASTOp::Const;
+        n.val_ = static_cast<int32_t>(folded);
+        n.left_child_ = AST_NONE;
+        n.right_child_ = AST_NONE;
+        n.depth_ = 0;
+        height[chain_root] = 0;
+        return chain_root;
+    }
 
-    x->right_child_ = node;
-    node->left_child_ = x_r;
+    // Huffman-style merge: always combine the two shallowest operands. For a product this gives the
+    // minimum multiplicative depth, for a sum the multiplicative depth is fixed and the shortest
+    // critical path is built instead. Ties are broken by position so every node builds the same tree.
+    auto later = [](const Term &a, const Term &b)
+    {
+        return std::tie(a.depth, a.height, a.seq) > std::tie(b.depth, b.height, b.seq);
+    };
+    std::priority_queue<Term, std::vector<Term>, decltype(later)> queue(later, std::move(terms));
 
-    x->parent_ = node->parent_;
-    if (node->parent_)
+    auto seq = static_cast<uint32_t>(queue.size());
+    while (queue.size() > 1)
     {
-        node->parent_->notify_child_change(x, node->node_id_);
+        auto a = queue.top();
+        queue.pop();
+        auto b = queue.top();
+        queue.pop();
+
+        auto node = free_nodes.back();
+        free_nodes.pop_back();
+        auto &n = nodes_[node];
+
+        Term merged{node, false, std::max(a.depth, b.depth), 1 + std::max(a.height, b.height), seq++};
+        if (is_product)
+        {
+            n.op_ = ASTOp::Mul;
+            ++merged.depth;
+        }
+        else if (a.negative == b.negative)
+        {
+            // a + b, or -a - b = -(a + b)
+            n.op_ = ASTOp::Add;
+            merged.negative = a.negative;
+        }
+        else
+        {
+            // the positive operand goes first
+            n.op_ = ASTOp::Sub;
+            if (a.negative)
+            {
+                std::swap(a, b);
+            }
+        }
+
+        n.val_ = 0;
+        n.left_child_ = a.node;
+        n.right_child_ = b.node;
+        n.depth_ = merged.depth;
+        nodes_[a.node].parent_ = node;
+        nodes_[b.node].parent_ = node;
+        height[node] = merged.height;
+
+        queue.push(merged);
     }
-    node->parent_ = x;
 
-    node->depth_ = 1 + std::max(get_depth(node->left_child_), get_depth(node->right_child_));
-    x->depth_ = 1 + std::max(get_depth(x->left_child_), get_depth(x->right_child_));
+    // the constant goes last, so it is applied once to the merged ciphertext operands
+    auto merged = queue.top();
+    if (is_product)
+    {
+        return (has_const && folded != 1) ? apply_const(ASTOp::Mul, merged.node, folded, height) : merged.node;
+    }
 
-    // return the new root of the subtree
-    return x;
+    // merging never loses the last positive operand, so the result is only negated if every ciphertext
+    // operand is, as in #5 - x. It is then computed as x * #-1 + #5
+    auto root = merged.node;
+    if (merged.negative)
+    {
+        root = apply_const(ASTOp::Mul, root, -1, height);
+    }
+    return (folded != 0) ? apply_const(ASTOp::Add, root, folded, height) : root;
 }
 
-std::shared_ptr<ASTNode> ASTree::left_rotate(std::shared_ptr<ASTNode> node)
+void ASTree::rebuild_pow(uint32_t node, std::vector<int32_t> &height)
 {
-    auto x = node->right_child_;
-    auto x_l = x->left_child_;
+    auto &n = nodes_[node];
+    auto base = n.left_child_;
+    auto parent = n.parent_;
 
-    x->left_child_ = node;
-    node->right_child_ = x_l;
+    if (nodes_[base].is_const())
+    {
+        int64_t value = nodes_[base].val_;
+        int64_t folded = 1;
+        if (value == 0 || value == 1)
+        {
+            folded = value;
+        }
+        else if (value == -1)
+        {
+            folded = (n.val_ & 1) ? -1 : 1;
+        }
+        else
+        {
+            // |value| >= 2, so this overflows within 32 steps
+            for (int32_t i = 0; i < n.val_; ++i)
+            {
+                folded *= value;
+                if (folded < INT32_MIN || folded > INT32_MAX)
+                {
+                    throw std::out_of_range("Invalid expression syntax: constant too large.");
+                }
+            }
+        }
+        n.op_ = ASTOp::Const;
+        n.val_ = static_cast<int32_t>(folded);
+        n.left_child_ = AST_NONE;
+        n.depth_ = 0;
+        height[node] = 0;
+        return;
+    }
 
-    x->parent_ = node->parent_;
-    if (node->parent_)
+    if (n.val_ == 1)
     {
-        node->parent_->notify_child_change(x, node->node_id_);
+        // x^1 is the base itself
+        nodes_[base].parent_ = parent;
+        if (parent == AST_NONE)
+        {
+            root_ = base;
+        }
+        else
+        {
+            notify_child_change(parent, base, node);
+        }
+        return;
     }
-    node->parent_ = x;
 
-    node->depth_ = 1 + std::max(get_depth(node->left_child_), get_depth(node->right_child_));
-    x->depth_ = 1 + std::max(get_depth(x->left_child_), get_depth(x->right_child_));
+    auto added = pow_depth(n.val_);
+    n.depth_ = nodes_[base].depth_ + added;
+    height[node] = height[base] + added;
+}
 
-    // return the new root of the subtree
-    return x;
+uint32_t ASTree::apply_const(ASTOp op, uint32_t operand, int64_t value, std::vector<int32_t> &height)
+{
+    auto constant = add_node(ASTOp::Const, static_cast<int32_t>(value));
+    auto node = add_node(op, 0);
+    height.resize(nodes_.size(), 0);
+
+    auto &n = nodes_[node];
+    n.left_child_ = operand;
+    n.right_child_ = constant;
+    // operations with a plaintext do not consume a level
+    n.depth_ = nodes_[operand].depth_;
+    nodes_[operand].parent_ = node;
+    nodes_[constant].parent_ = node;
+    height[node] = height[operand] + 1;
+    return node;
 }
 
-void ASTree::build_tree()
+void ASTree::compile(bool cse)
 {
-    // std::stack<std::shared_ptr<ASTNode>> node_stack;
-    std::shared_ptr<ASTNode> curr_node;
-    for (auto it = input_.rbegin(); it != input_.rend(); ++it)
+    if (nodes_[root_].is_const())
+    {
+        throw std::invalid_argument("Invalid expression syntax: no ciphertext operand.");
+    }
+
+    program_.clear();
+    program_.reserve(nodes_.size());
+
+    // a node is identified by its op and its (already emitted) operands, leaves by their value
+    struct InstrKeyHash
     {
-        // start from reverse input
-        // when operator is found, a new node must be added to the most recent node with available spots
-        // a stack is used for this
+        std::size_t operator()(const std::tuple<ASTOp, uint32_t, uint32_t> &k) const
+        {
+            auto h = std::hash<uint32_t>()(std::get<1>(k)) * 31 + std::hash<uint32_t>()(std::get<2>(k));
+            return h * 31 + static_cast<std::size_t>(std::get<0>(k));
+        }
+    };
+    std::unordered_map<std::tuple<ASTOp, uint32_t, uint32_t>, uint32_t, InstrKeyHash> emitted;
 
-        if (!node_stack.empty())
+    // returns the index of the instruction, an existing one with cse
+    auto emit = [&](const ASTInstr &instr)
+    {
+        if (cse)
         {
-            curr_node = node_stack.top();
-            while (curr_node->is_full())
+            std::tuple<ASTOp, uint32_t, uint32_t> key;
+            if (instr.op_ == ASTOp::Leaf || instr.op_ == ASTOp::Const)
+            {
+                key = {instr.op_, static_cast<uint32_t>(instr.val_), 0};
+            }
+            else if (instr.op_ == ASTOp::Sub)
+            {
+                // subtraction is the only non commutative operation
+                key = {instr.op_, instr.left_, instr.right_};
+            }
+            else
+            {
+                key = {instr.op_, std::min(instr.left_, instr.right_), std::max(instr.left_, instr.right_)};
+            }
+
+            auto [it, inserted] = emitted.try_emplace(key, static_cast<uint32_t>(program_.size()));
+            if (!inserted)
             {
-                node_stack.pop();
-                curr_node = node_stack.top();
+                return it->second;
             }
         }
 
+        program_.push_back(instr);
+        return static_cast<uint32_t>(program_.size() - 1);
+    };
+
+    auto emit_mul = [&](uint32_t left, uint32_t right)
+    {
+        ASTInstr instr;
+        instr.op_ = ASTOp::Mul;
+        instr.left_ = left;
+        instr.right_ = right;
+        instr.val_ = 0;
+        instr.depth_ = std::max(program_[left].depth_, program_[right].depth_) + 1;
+        instr.degree_ = 2;
+        return emit(instr);
+    };
 
-        std::shared_ptr<ASTNode> new_node;
+    // square-and-multiply, the squares are shared by the factors that need them. Factors are merged
+    // shallowest first, which gives the depth of pow_depth
+    auto emit_pow = [&](uint32_t base, int32_t exponent)
+    {
+        auto shallower = [this](uint32_t a, uint32_t b)
+        {
+            return std::make_pair(program_[a].depth_, a) > std::make_pair(program_[b].depth_, b);
+        };
+        std::priority_queue<uint32_t, std::vector<uint32_t>, decltype(shallower)> factors(shallower);
 
-        if (*it == "+" || *it == "*" || *it == "-")
+        auto square = base;
+        for (auto k = exponent; k != 0; k >>= 1)
         {
-            new_node = std::make_shared<ASTNode>(node_counter_++, *it == "*", nullptr, *it);
+            if (k & 1)
+            {
+                factors.push(square);
+            }
+            if (k > 1)
+            {
+                square = emit_mul(square, square);
+            }
         }
-        else
+        while (factors.size() > 1)
         {
-            new_node = std::make_shared<ASTNode>(node_counter_++, std::stoi(*it), nullptr);
+            auto a = factors.top();
+            factors.pop();
+            auto b = factors.top();
+            factors.pop();
+            factors.push(emit_mul(a, b));
         }
+        return factors.top();
+    };
+
+    // instruction emitted for every node
+    std::vector<uint32_t> instr_of(nodes_.size(), AST_NONE);
+
+    // iterative post order, so operands are emitted before their user
+    std::stack<std::pair<uint32_t, bool>> to_visit;
+    to_visit.push({root_, false});
+    while (!to_visit.empty())
+    {
+        auto [node, expanded] = to_visit.top();
+        to_visit.pop();
+        const auto &n = nodes_[node];
 
-        if (!root_)
+        if (n.op_ == ASTOp::Pow && !expanded)
         {
-            root_ = new_node;
-            // root parent is left null
+            to_visit.push({node, true});
+            to_visit.push({n.left_child_, false});
+            continue;
         }
-        else
+        if (!n.is_leaf() && !expanded)
         {
-            new_node->parent_ = curr_node;
-            bool is_full = curr_node->insert_child(new_node);
-
-            if (new_node->counts_for_depth_)
+            if (n.left_child_ == AST_NONE || n.right_child_ == AST_NONE)
             {
-                root_ = reorg_from(curr_node);
-            }
-
-            if (is_full)
-            {
-                node_stack.pop();
+                throw std::runtime_error("Internal ASTNode should have both chldren.");
             }
+            to_visit.push({node, true});
+            to_visit.push({n.right_child_, false});
+            to_visit.push({n.left_child_, false});
+            continue;
         }
-        if (!new_node->is_leaf)
+
+        if (n.op_ == ASTOp::Pow)
         {
-            node_stack.push(new_node);
+            instr_of[node] = emit_pow(instr_of[n.left_child_], n.val_);
+            continue;
         }
+
+        ASTInstr instr;
+        instr.op_ = n.op_;
+        instr.val_ = n.val_;
+        instr.depth_ = n.depth_;
+        instr.degree_ = 2;
+        instr.left_ = n.is_leaf() ? AST_NONE : instr_of[n.left_child_];
+        instr.right_ = n.is_leaf() ? AST_NONE : instr_of[n.right_child_];
+        instr_of[node] = emit(instr);
     }
 }
 
-std::shared_ptr<ASTNode> ASTree::reorg_from(std::shared_ptr<ASTNode> node)
+void ASTree::schedule(const std::vector<uint32_t> &input_degrees)
 {
+    if (is_scheduled_)
+    {
+        throw std::logic_error("AST program is already scheduled.");
+    }
+    is_scheduled_ = true;
+    schedule_report_ = {};
+
+    std::vector<ASTInstr> scheduled;
+    scheduled.reserve(program_.size());
+    std::vector<uint32_t> new_idx(program_.size());
 
-    std::shared_ptr<ASTNode> curr = node;
-    if (node->counts_for_depth_)
+    // every intermediate level reached by a value, keyed by (instruction, depth), so that a value used at
+    // the same level by several instructions is aligned only once
+    std::map<std::pair<uint32_t, int32_t>, uint32_t> aligned;
+    // leaves with the same ciphertext are the same value
+    std::unordered_map<int32_t, uint32_t> leaf_instr;
+
+    auto emit = [&scheduled](ASTOp op, uint32_t operand, int32_t depth, uint32_t degree)
     {
-        node->depth_ = 1 + std::max(get_depth(node->left_child_), get_depth(node->right_child_));
+        ASTInstr instr;
+        instr.op_ = op;
+        instr.left_ = operand;
+        instr.right_ = AST_NONE;
+        instr.val_ = 0;
+        instr.depth_ = depth;
+        instr.degree_ = degree;
+        scheduled.push_back(instr);
+        return static_cast<uint32_t>(scheduled.size() - 1);
+    };
 
-        int balance = get_balance(node);
+    auto align = [&](uint32_t operand, int32_t target)
+    {
+        auto steps = target - scheduled[operand].depth_;
+        // previously every step was a Relinearize followed by a Rescale
+        schedule_report_.naive_relins += steps;
+        schedule_report_.naive_rescales += steps;
 
-        if (node->can_rotate_right() && balance > 1 && get_balance(node->left_child_) > 0)
+        uint32_t curr = operand;
+        for (auto depth = scheduled[operand].depth_ + 1; depth <= target; ++depth)
         {
-            // no need for stack adjustment due to the order of insertions. The left child will be full
-            // but this will be caught by the is_full check during insert.
-            curr = right_rotate(node);
+            auto it = aligned.find({operand, depth});
+            if (it != aligned.end())
+            {
+                curr = it->second;
+                continue;
+            }
+
+            // key switching is only needed while the value has more than two elements
+            if (scheduled[curr].degree_ > 2)
+            {
+                curr = emit(ASTOp::Relin, curr, scheduled[curr].depth_, 2);
+                ++schedule_report_.relins;
+            }
+            curr = emit(ASTOp::Rescale, curr, depth, scheduled[curr].degree_);
+            ++schedule_report_.rescales;
+            aligned[{operand, depth}] = curr;
         }
-        else if (node->can_rotate_left() && balance < -1 && get_balance(node->right_child_) < 0)
+        return curr;
+    };
+
+    for (std::size_t i = 0; i < program_.size(); ++i)
+    {
+        auto instr = program_[i];
+
+        if (instr.op_ == ASTOp::Leaf)
         {
-            // no need for stack adjustment. The right child will be full, but this will be
-            // caught by the is_full check during insert. The order of the others is correct
-            curr = left_rotate(node);
+            auto it = leaf_instr.find(instr.val_);
+            if (it != leaf_instr.end())
+            {
+                new_idx[i] = it->second;
+                continue;
+            }
+
+            instr.degree_ = (static_cast<std::size_t>(instr.val_) < input_degrees.size()) ? input_degrees[instr.val_] : 2;
+            scheduled.push_back(instr);
+            new_idx[i] = leaf_instr[instr.val_] = scheduled.size() - 1;
+            continue;
         }
-        else if (node->can_rotate_right() && balance > 1 && get_balance(node->left_child_) < 0 && node->left_child_->can_rotate_left())
-        {
 
-            // similarly with below, `node` after the rotation has one free spot and should receive the next node
-            node_stack.push(node);
-            node->left_child_ = left_rotate(node->left_child_);
-            curr = right_rotate(node);
+        if (instr.op_ == ASTOp::Const)
+        {
+            // folded into the instruction using it
+            new_idx[i] = AST_NONE;
+            continue;
         }
-        else if (node->can_rotate_left() && balance < -1 && get_balance(node->right_child_) > 0 && node->right_child_->can_rotate_right())
+
+        if (program_[instr.left_].op_ == ASTOp::Const || program_[instr.right_].op_ == ASTOp::Const)
         {
-            // next position to insert changes because of this rotation, so node_stack needs to
-            // be adjusted
+            // rebalancing leaves constants only as the right operand of + and *
+            if (program_[instr.left_].op_ == ASTOp::Const || (instr.op_ != ASTOp::Add && instr.op_ != ASTOp::Mul))
+            {
+                throw std::logic_error("Unexpected constant operand in AST program.");
+            }
 
-            // in this case the node->right_child_ will once again have one spot left, so it needs to be
-            // added to the stack to receive the next node
-            // the parent is already there
-            node_stack.push(node->right_child_);
-            node->right_child_ = right_rotate(node->right_child_);
-            curr = left_rotate(node);
+            // the ciphertext operand is used at its own level and keeps its degree
+            instr.val_ = program_[instr.right_].val_;
+            instr.op_ = (instr.op_ == ASTOp::Add) ? ASTOp::AddPlain : ASTOp::MulPlain;
+            instr.left_ = new_idx[instr.left_];
+            instr.right_ = AST_NONE;
+            instr.depth_ = scheduled[instr.left_].depth_;
+            instr.degree_ = scheduled[instr.left_].degree_;
+
+            scheduled.push_back(instr);
+            new_idx[i] = scheduled.size() - 1;
+            continue;
         }
-    }
-    else
-    {
-        // this node does not count for depth, so just propagate current
-        node->depth_ = std::max(get_depth(node->left_child_), get_depth(node->right_child_));
-    }
 
-    // move to parent to reorg
-    if (curr->parent_)
-    {
-        return reorg_from(curr->parent_);
+        // bring both operands to the level of the deeper one
+        auto left = new_idx[instr.left_];
+        auto right = new_idx[instr.right_];
+        auto target = std::max(scheduled[left].depth_, scheduled[right].depth_);
+        instr.left_ = align(left, target);
+        instr.right_ = align(right, target);
+
+        auto dl = scheduled[instr.left_].degree_;
+        auto dr = scheduled[instr.right_].degree_;
+        // products are left unrelinearized, so sums of products share a single relinearization later on
+        instr.degree_ = (instr.op_ == ASTOp::Mul) ? dl + dr - 1 : std::max(dl, dr);
+
+        scheduled.push_back(instr);
+        new_idx[i] = scheduled.size() - 1;
     }
-    return curr;
+
+    program_ = std::move(scheduled);
 }
 
-std::deque<std::string> ASTree::shunt(const std::string &expression)
+std::vector<ASTToken> ASTree::shunt(const std::string &expression)
 {
+    std::vector<ASTToken> output_q;
+    output_q.reserve(expression.size());
 
-    std::deque<std::string> output_q;
-
-    std::unordered_map<char, int> precedence = {
-        {'+', 2},
-        {'-', 2},
-        {'*', 3},
+    auto precedence = [](char op)
+    {
+        return (op == '*') ? 3 : 2;
+    };
+    auto to_token = [](char op)
+    {
+        switch (op)
+        {
+        case '+':
+            return ASTToken{ASTOp::Add, 0};
+        case '-':
+            return ASTToken{ASTOp::Sub, 0};
+        default:
+            return ASTToken{ASTOp::Mul, 0};
+        }
     };
 
-    std::stack<std::string> number_stack;
-    std::stack<std::string> operator_stack;
+    // holds operators and '('
+    std::vector<char> operator_stack;
+    std::size_t operators_found = 0;
 
     auto n = expression.size();
     // indicates if previous token was number
@@ -273,23 +767,35 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
     {
         char token = expression[i];
 
-        // current token as string
-        std::string entry(1, token);
+        // constant token, its digits follow
+        if (token == '#')
+        {
+            if (found_num || i + 1 == n || !std::isdigit(static_cast<unsigned char>(expression[i + 1])))
+            {
+                throw std::invalid_argument("Invalid expression syntax: '#' must be followed by a number.");
+            }
+            found_operation_operator = false;
+            output_q.push_back({ASTOp::Const, 0});
+            found_num = true;
+            continue;
+        }
+
         // found number token
-        if (std::isdigit(token))
+        if (std::isdigit(static_cast<unsigned char>(token)))
         {
             found_operation_operator = false;
-            // if previous token was number as well, append it to previous token
-            if (found_num)
+            // if previous token was number as well, this digit extends it
+            if (!found_num)
             {
-                output_q.back().append(std::move(entry));
+                output_q.push_back({ASTOp::Leaf, 0});
+                found_num = true;
             }
-            else
+            int64_t val = static_cast<int64_t>(output_q.back().val_) * 10 + (token - '0');
+            if (val > INT32_MAX)
             {
-                // previous token was not number, push new entry
-                output_q.push_back(std::move(entry));
-                found_num = true;
+                throw std::out_of_range(output_q.back().op_ == ASTOp::Const ? "Invalid expression syntax: constant too large." : "Invalid expression syntax: ciphertext index too large.");
             }
+            output_q.back().val_ = static_cast<int32_t>(val);
             continue;
         }
         found_num = false;
@@ -300,7 +806,7 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
             continue;
 
         case '(':
-            operator_stack.push(std::move(entry));
+            operator_stack.push_back(token);
             found_operation_operator = true;
             break;
 
@@ -308,16 +814,16 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
             found_operation_operator = false;
 
             // pop operators until first left parenthesis is found
-            while (!operator_stack.empty() && operator_stack.top()[0] != '(')
+            while (!operator_stack.empty() && operator_stack.back() != '(')
             {
-                output_q.push_back(std::move(operator_stack.top()));
-                operator_stack.pop();
+                output_q.push_back(to_token(operator_stack.back()));
+                operator_stack.pop_back();
             }
 
             // loop stopped before emptying stack, meaning left parenthesis was found
             if (!operator_stack.empty())
             {
-                operator_stack.pop();
+                operator_stack.pop_back();
             }
             else
             {
@@ -326,6 +832,34 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
             }
             break;
 
+        case '^':
+        {
+            // constant exponent. It binds tighter than any other operator, so the operand before it is
+            // already complete in the output and the power is emitted right away: x^2^3 is (x^2)^3
+            if (i == 0 || found_operation_operator)
+            {
+                throw std::invalid_argument("Invalid expression syntax: '^' must follow an operand.");
+            }
+            int64_t exponent = 0;
+            auto j = i + 1;
+            for (; j < n && std::isdigit(static_cast<unsigned char>(expression[j])); ++j)
+            {
+                exponent = exponent * 10 + (expression[j] - '0');
+                if (exponent > INT32_MAX)
+                {
+                    throw std::out_of_range("Invalid expression syntax: exponent too large.");
+                }
+            }
+            if (exponent == 0)
+            {
+                throw std::invalid_argument("Invalid expression syntax: '^' must be followed by a positive exponent.");
+            }
+            ++operators_found;
+            output_q.push_back({ASTOp::Pow, static_cast<int32_t>(exponent)});
+            i = j - 1;
+            break;
+        }
+
         case '+':
         case '-':
         case '*':
@@ -341,15 +875,16 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
             {
                 throw std::invalid_argument("Invalid expression syntax: cannot start or end with operator.");
             }
+            ++operators_found;
 
-            while (!operator_stack.empty() && operator_stack.top()[0] != '(' && precedence[token] <= precedence[operator_stack.top()[0]])
+            while (!operator_stack.empty() && operator_stack.back() != '(' && precedence(token) <= precedence(operator_stack.back()))
             {
                 // here it is assumed that all operations are left associative
                 // so even if equal, the top() will be pushed to the output
-                output_q.push_back(std::move(operator_stack.top()));
-                operator_stack.pop();
+                output_q.push_back(to_token(operator_stack.back()));
+                operator_stack.pop_back();
             }
-            operator_stack.push(std::move(entry));
+            operator_stack.push_back(token);
             break;
 
         default:
@@ -357,19 +892,19 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
         }
     }
 
-    if (operator_stack.empty())
+    if (operators_found == 0)
     {
         throw std::invalid_argument("Invalid expression syntax: no operators found");
     }
 
     while (!operator_stack.empty())
     {
-        if (operator_stack.top()[0] == '(')
+        if (operator_stack.back() == '(')
         {
             throw std::invalid_argument("Invalid expression syntax: mismatched '('");
         }
-        output_q.push_back(std::move(operator_stack.top()));
-        operator_stack.pop();
+        output_q.push_back(to_token(operator_stack.back()));
+        operator_stack.pop_back();
     }
 
     return output_q;
@@ -378,43 +913,54 @@ std::deque<std::string> ASTree::shunt(const std::string &expression)
 void ASTree::bfs_print()
 {
     std::cout << "==============" << std::endl;
-    std::deque<std::shared_ptr<ASTNode>> q;
-    auto s = root_;
-    q.push_back(s);
-
-    std::unordered_map<int, int> discovered;
-    discovered[s->node_id_] = 0;
+    std::deque<std::pair<uint32_t, int>> q;
+    q.push_back({root_, 0});
     int curr_disc = 0;
 
     while (!q.empty())
     {
-        auto top = q.front();
+        auto [top, level] = q.front();
         q.pop_front();
-        if (discovered[top->node_id_] > curr_disc)
+        if (level > curr_disc)
         {
             ++curr_disc;
             std::cout << std::endl;
         }
-        if (top->is_leaf)
-        {
-            std::cout << top->val_;
-        }
-        else
+
+        const auto &n = nodes_[top];
+        switch (n.op_)
         {
-            std::cout << top->op_;
+        case ASTOp::Leaf:
+            std::cout << n.val_;
+            break;
+        case ASTOp::Const:
+            std::cout << "#" << n.val_;
+            break;
+        case ASTOp::Add:
+            std::cout << "+";
+            break;
+        case ASTOp::Sub:
+            std::cout << "-";
+            break;
+        case ASTOp::Mul:
+            std::cout << "*";
+            break;
+        case ASTOp::Pow:
+            std::cout << "^" << n.val_;
+            break;
+        default:
+            break;
         }
         std::cout << "  |   ";
 
-        if (top->left_child_)
+        if (n.left_child_ != AST_NONE)
         {
-            discovered[top->left_child_->node_id_] = discovered[top->node_id_] + 1;
-            q.push_back(top->left_child_);
+            q.push_back({n.left_child_, level + 1});
         }
-        if (top->right_child_)
+        if (n.right_child_ != AST_NONE)
         {
-            discovered[top->right_child_->node_id_] = discovered[top->node_id_] + 1;
-            q.push_back(top->right_child_);
+            q.push_back({n.right_child_, level + 1});
         }
     }
     std::cout << std::endl;
-}
\ No newline at end of file
+}
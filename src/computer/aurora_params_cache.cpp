@@ -0,0 +1,77 @@
+#include "computer/aurora_params_cache.hpp"
+
+#include <iostream>
+#include <stdexcept>
+
+AuroraParamSet AuroraParamSet::standard()
+{
+    AuroraParamSet set;
+    set.security_parameter = 128;
+    set.RS_extra_dimensions = 2;
+    set.FRI_localization_parameter = 3;
+    set.ldt_reducer_soundness_type = libiop::LDT_reducer_soundness_type::optimistic_heuristic;
+    set.fri_soundness_type = libiop::FRI_soundness_type::heuristic;
+    set.domain_type = libiop::affine_subspace_type;
+    set.make_zk = false;
+    return set;
+}
+
+AuroraParamsCache &AuroraParamsCache::instance()
+{
+    static AuroraParamsCache cache;
+    return cache;
+}
+
+std::shared_ptr<const AuroraParamsCache::Params> AuroraParamsCache::get(const AuroraParamSet &set, std::size_t num_constraints, std::size_t num_variables)
+{
+    Key key(set.security_parameter, set.RS_extra_dimensions, set.FRI_localization_parameter,
+            static_cast<int>(set.ldt_reducer_soundness_type), static_cast<int>(set.fri_soundness_type),
+            static_cast<int>(set.domain_type), set.make_zk, num_constraints, num_variables);
+
+    {
+        std::lock_guard<std::mutex> lg(mu_);
+        auto it = params_.find(key);
+        if (it != params_.end())
+        {
+            return it->second;
+        }
+    }
+
+    // built without holding the lock, so other sizes are not blocked. If two threads build the same entry,
+    // the first one is kept
+    auto params = std::make_shared<const Params>(
+        set.security_parameter,
+        set.ldt_reducer_soundness_type,
+        set.fri_soundness_type,
+        libiop::blake2b_type,
+        set.FRI_localization_parameter,
+        set.RS_extra_dimensions,
+        set.make_zk,
+        set.domain_type,
+        num_constraints,
+        num_variables);
+
+    std::lock_guard<std::mutex> lg(mu_);
+    return params_.emplace(key, std::move(params)).first->second;
+}
+
+void AuroraParamsCache::warm_up(const json &sizes)
+{
+    auto set = AuroraParamSet::standard();
+    for (const auto &size : sizes)
+    {
+        std::size_t num_constraints = size.at(0);
+        std::size_t num_variables = size.at(1);
+
+        // only padded sizes ever reach the prover
+        bool constraints_padded = num_constraints > 0 && (num_constraints & (num_constraints - 1)) == 0;
+        bool variables_padded = ((num_variables + 1) & num_variables) == 0;
+        if (!constraints_padded || !variables_padded)
+        {
+            throw std::invalid_argument("Aurora warm-up sizes must be padded: constraints a power of two, variables a power of two minus one.");
+        }
+
+        get(set, num_constraints, num_variables);
+        std::cout << "Aurora parameters ready for " << num_constraints << " constraints, " << num_variables << " variables" << std::endl;
+    }
+}
@@ -0,0 +1,191 @@
+#include "computer/cost_model.hpp"
+#include "computer/aurora_params_cache.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+namespace
+{
+    uint64_t next_pow2(uint64_t n)
+    {
+        uint64_t p = 1;
+        while (p < n)
+        {
+            p <<= 1;
+        }
+        return p;
+    }
+}
+
+const std::vector<std::string> &CostModel::kinds()
+{
+    static const std::vector<std::string> kinds = {"add", "mul", "plain", "relin", "rescale", "output"};
+    return kinds;
+}
+
+CostModel::CostModel() : variables_per_constraint_(1)
+{
+    // rough defaults, replaced by the calibrated ones of the config
+    weights_ = {{"add", 1}, {"mul", 1}, {"plain", 1}, {"relin", 8}, {"rescale", 4}, {"output", 1}};
+    times_[ProofBackendType::Aurora] = {0.5, 4e-6, 0.05, 1.5e-6};
+    times_[ProofBackendType::Ligero] = {0.1, 1.5e-6, 0.05, 1.5e-6};
+    times_[ProofBackendType::Fractal] = {1.0, 1.2e-5, 0.05, 2e-8};
+}
+
+CostModel &CostModel::instance()
+{
+    static CostModel model;
+    return model;
+}
+
+void CostModel::configure(const json &config)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    for (const auto &item : config.value("weights", json::object()).items())
+    {
+        weights_.at(item.key()) = item.value().get<double>();
+    }
+    variables_per_constraint_ = config.value("variables_per_constraint", variables_per_constraint_);
+
+    for (const auto &item : config.value("backends", json::object()).items())
+    {
+        auto &t = times_.at(ProofBackend::from_name(item.key()));
+        const auto &times = item.value();
+        t.prove_fixed_s = times.value("prove_fixed_s", t.prove_fixed_s);
+        t.prove_s = times.value("prove_s", t.prove_s);
+        t.verify_fixed_s = times.value("verify_fixed_s", t.verify_fixed_s);
+        t.verify_s = times.value("verify_s", t.verify_s);
+    }
+}
+
+json CostModel::config()
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    json backends = json::object();
+    for (const auto &[type, t] : times_)
+    {
+        backends[ProofBackend::name(type)] = {{"prove_fixed_s", t.prove_fixed_s}, {"prove_s", t.prove_s}, {"verify_fixed_s", t.verify_fixed_s}, {"verify_s", t.verify_s}};
+    }
+    return {{"weights", weights_}, {"variables_per_constraint", variables_per_constraint_}, {"backends", backends}};
+}
+
+CostModel::Units CostModel::units(const std::vector<ASTInstr> &program, CryptoContext<DCRTPoly> cc, const std::vector<Ciphertext<DCRTPoly>> &inputs, CostEstimate *counts)
+{
+    CostEstimate unused;
+    auto &est = counts ? *counts : unused;
+    double ring_dim = cc->GetRingDimension();
+
+    Units units;
+    for (const auto &kind : kinds())
+    {
+        units[kind] = 0;
+    }
+
+    // RNS towers left at every instruction, the inputs may start at different levels
+    std::vector<uint32_t> towers(program.size(), 1);
+    for (std::size_t i = 0; i < program.size(); ++i)
+    {
+        const auto &instr = program[i];
+        if (instr.op_ == ASTOp::Leaf)
+        {
+            towers[i] = inputs.at(instr.val_)->GetElements()[0].GetNumOfElements();
+            continue;
+        }
+
+        // operands are aligned by the scheduling pass, so both have the towers of the left one
+        towers[i] = towers[instr.left_];
+        double degree = program[instr.left_].degree_;
+        double per_tower = ring_dim * towers[instr.left_];
+        switch (instr.op_)
+        {
+        case ASTOp::Add:
+        case ASTOp::Sub:
+            ++est.additions;
+            units["add"] += instr.degree_ * per_tower;
+            break;
+        case ASTOp::Mul:
+            // per pair of multiplied elements
+            ++est.multiplications;
+            units["mul"] += degree * program[instr.right_].degree_ * per_tower;
+            break;
+        case ASTOp::AddPlain:
+            // only the first element changes
+            ++est.plaintext_ops;
+            units["plain"] += per_tower;
+            break;
+        case ASTOp::MulPlain:
+            ++est.plaintext_ops;
+            units["plain"] += degree * per_tower;
+            break;
+        case ASTOp::Relin:
+            // per element switched back to two
+            ++est.key_switches;
+            units["relin"] += (degree - 2) * per_tower;
+            break;
+        case ASTOp::Rescale:
+            ++est.rescales;
+            towers[i] = std::max<uint32_t>(towers[instr.left_], 2) - 1;
+            units["rescale"] += degree * per_tower;
+            break;
+        default:
+            throw std::invalid_argument("Unexpected op in scheduled AST program.");
+        }
+    }
+    // the computed output is constrained to be the public one
+    units["output"] += program.back().degree_ * towers.back() * ring_dim;
+    return units;
+}
+
+CostEstimate CostModel::estimate(const std::vector<ASTInstr> &program, CryptoContext<DCRTPoly> cc, const std::vector<Ciphertext<DCRTPoly>> &inputs)
+{
+    CostEstimate est;
+    auto op_units = units(program, cc, inputs, &est);
+
+    {
+        std::lock_guard<std::mutex> lg(mu_);
+        double constraints = 0;
+        for (const auto &[kind, u] : op_units)
+        {
+            constraints += weights_.at(kind) * u;
+        }
+        est.constraints = std::max<uint64_t>(1, std::llround(constraints));
+        est.variables = std::llround(est.constraints * variables_per_constraint_);
+    }
+
+    // padded as the libiop conversion does: constraints to a power of two, variables to one less
+    est.padded_constraints = next_pow2(est.constraints);
+    est.padded_variables = next_pow2(est.variables + 1) - 1;
+    // Aurora sums over a domain covering both, and tests degrees of about twice its size over a codeword
+    // domain larger by the extra RS dimensions
+    auto summation = std::max(est.padded_constraints, est.padded_variables + 1);
+    est.aurora_domain = (summation << 1) << AuroraParamSet::standard().RS_extra_dimensions;
+
+    auto backend = ProofBackendPolicy::instance().select(est.padded_constraints);
+    est.backend = ProofBackend::name(backend);
+
+    std::lock_guard<std::mutex> lg(mu_);
+    const auto &t = times_.at(backend);
+    double size = est.padded_constraints;
+    est.prove_s = t.prove_fixed_s + t.prove_s * size * std::log2(size);
+    est.verify_s = t.verify_fixed_s + t.verify_s * size;
+    return est;
+}
+
+json CostModel::to_json(const CostEstimate &estimate)
+{
+    return {
+        {"multiplications", estimate.multiplications},
+        {"additions", estimate.additions},
+        {"plaintext_ops", estimate.plaintext_ops},
+        {"key_switches", estimate.key_switches},
+        {"rescales", estimate.rescales},
+        {"constraints", estimate.constraints},
+        {"variables", estimate.variables},
+        {"padded_constraints", estimate.padded_constraints},
+        {"padded_variables", estimate.padded_variables},
+        {"aurora_domain", estimate.aurora_domain},
+        {"backend", estimate.backend},
+        {"prove_s", estimate.prove_s},
+        {"verify_s", estimate.verify_s}};
+}
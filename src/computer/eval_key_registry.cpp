@@ -0,0 +1,135 @@
+#include "computer/eval_key_registry.hpp"
+
+#include <sstream>
+#include <stdexcept>
+#include "sodium.h"
+#include "cryptocontext-ser.h"
+#include "key/key-ser.h"
+
+EvalKeyRegistry &EvalKeyRegistry::instance()
+{
+    static EvalKeyRegistry registry;
+    return registry;
+}
+
+std::size_t EvalKeyRegistry::key_bytes(const std::vector<EvalKey<DCRTPoly>> &keys)
+{
+    std::size_t bytes = 0;
+    for (const auto &key : keys)
+    {
+        for (const auto *elements : {&key->GetAVector(), &key->GetBVector()})
+        {
+            for (const auto &element : *elements)
+            {
+                bytes += element.GetNumOfElements() * element.GetRingDimension() * sizeof(uint64_t);
+            }
+        }
+    }
+    return bytes;
+}
+
+std::shared_lock<std::shared_mutex> EvalKeyRegistry::lookup_lock()
+{
+    return std::shared_lock<std::shared_mutex>(openfhe_mu_);
+}
+
+std::shared_ptr<const EvalKeyRegistry::Entry> EvalKeyRegistry::acquire(const std::string &serialized, const std::string &key_tag)
+{
+    std::vector<unsigned char> digest(crypto_generichash_BYTES);
+    crypto_generichash(digest.data(), digest.size(), reinterpret_cast<const unsigned char *>(serialized.data()), serialized.size(), nullptr, 0);
+    std::string k(digest.begin(), digest.end());
+
+    std::lock_guard<std::mutex> lg(mu_);
+    sweep_locked();
+
+    auto it = entries_.find(k);
+    if (it != entries_.end() && it->second->key_tag_ == key_tag)
+    {
+        ++hits_;
+        return it->second;
+    }
+
+    // deserialized apart from the global map, so a serialization holding keys of another tag is rejected before
+    // touching it
+    std::map<std::string, std::vector<EvalKey<DCRTPoly>>> keys;
+    std::istringstream iss(serialized);
+    Serial::Deserialize(keys, iss, SerType::BINARY);
+    if (keys.size() != 1 || keys.begin()->first != key_tag)
+    {
+        throw std::invalid_argument("EvalMultKey does not match the public key of the computation.");
+    }
+
+    auto entry = std::make_shared<Entry>();
+    entry->key_tag_ = key_tag;
+    std::string hex(2 * digest.size() + 1, '\0');
+    sodium_bin2hex(hex.data(), hex.size(), digest.data(), digest.size());
+    hex.pop_back();
+    entry->eval_tag_ = std::move(hex);
+    entry->keys_ = std::move(keys.begin()->second);
+    entry->serialized_ = std::make_shared<const std::string>(serialized);
+    entry->digest_ = std::move(digest);
+    // the serialization and the loaded keys
+    entry->bytes_ = serialized.size() + key_bytes(entry->keys_);
+
+    {
+        std::unique_lock<std::shared_mutex> ul(openfhe_mu_);
+        CryptoContextImpl<DCRTPoly>::GetAllEvalMultKeys()[entry->eval_tag_] = entry->keys_;
+    }
+    ++loads_;
+    bytes_ += entry->bytes_;
+    return entries_.emplace(k, std::move(entry)).first->second;
+}
+
+std::size_t EvalKeyRegistry::sweep()
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    return sweep_locked();
+}
+
+std::size_t EvalKeyRegistry::sweep_locked()
+{
+    std::size_t evicted = 0;
+    for (auto it = entries_.begin(); it != entries_.end();)
+    {
+        // handles are only handed out under the lock, so a count of one cannot grow meanwhile
+        if (it->second.use_count() > 1)
+        {
+            ++it;
+            continue;
+        }
+
+        {
+            std::unique_lock<std::shared_mutex> ul(openfhe_mu_);
+            CryptoContextImpl<DCRTPoly>::ClearEvalMultKeys(it->second->eval_tag_);
+        }
+        bytes_ -= it->second->bytes_;
+        it = entries_.erase(it);
+        ++evicted;
+    }
+
+    evictions_ += evicted;
+    return evicted;
+}
+
+json EvalKeyRegistry::metrics()
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    sweep_locked();
+
+    std::size_t holders = 0;
+    for (const auto &entry : entries_)
+    {
+        holders += entry.second.use_count() - 1;
+    }
+
+    json res;
+    res["entries"] = entries_.size();
+    res["bytes"] = bytes_;
+    res["holders"] = holders;
+    res["loads"] = loads_;
+    res["hits"] = hits_;
+    res["evictions"] = evictions_;
+    // OpenFHE shares a context among all the ciphertexts with the same parameters, and keeps it
+    res["contexts"] = CryptoContextFactory<DCRTPoly>::GetAllContexts().size();
+    return res;
+}
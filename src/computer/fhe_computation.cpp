@@ -1,8 +1,17 @@
 #include "computer/fhe_computation.hpp"
 
+#include <algorithm>
 #include <sstream>
+#include "sodium.h"
 #include "base64.hpp"
 #include "util/util.hpp"
+#include "util/byte_sink.hpp"
+#include "util/thread_pool.hpp"
+#include "computer/public_key_cache.hpp"
+
+#ifdef MULTICORE
+#include <omp.h>
+#endif
 
 using json = nlohmann::json;
 
@@ -13,6 +22,7 @@ FHEComputation::FHEComputation(const json &computation_json) : is_bound_(false)
     // save computation expression
     expression_ = computation_json.at("expression");
     timestamp_ = computation_json.at("timestamp");
+    cse_ = computation_json.value("cse", false);
 
     // check if ciphertexts are indeed provided
     if (!computation_json["ciphertexts"].size())
@@ -28,30 +38,62 @@ FHEComputation::FHEComputation(const json &computation_json) : is_bound_(false)
             throw std::invalid_argument("Ciphertexts must be strings.");
         }
 
-        auto cipher_str = base64::decode(c);
-        std::istringstream iss(cipher_str);
+        auto cipher_str = std::make_shared<const std::string>(base64::decode(c));
+        std::istringstream iss(*cipher_str);
 
         Ciphertext<DCRTPoly> cipher;
         Serial::Deserialize(cipher, iss, SerType::BINARY);
 
         ciphertexts_.push_back(cipher);
+        ciphertext_bytes_.push_back(std::move(cipher_str));
     }
 
-    // if expression contains a multiplication, EvalMultKeys are needed
-    if (expression_.find('*') != std::string::npos)
+    auto pubkey_str = base64::decode(computation_json.at("public_key"));
+    auto pubkey = PublicKeyCache::instance().get(pubkey_str);
+    publicKey_ = pubkey->key_;
+    public_key_bytes_ = pubkey->serialized_;
+
+    // if expression contains a multiplication or a power, EvalMultKeys are needed
+    if (expression_.find_first_of("*^") != std::string::npos)
     {
-        auto k_str = base64::decode(computation_json.at("eval_mult_key"));
-        std::istringstream iss(k_str);
-        GetCryptoContext()->DeserializeEvalMultKey(iss, SerType::BINARY);
+        load_evalmult_key(base64::decode(computation_json.at("eval_mult_key")));
     }
-
-    auto pubkey_str = base64::decode(computation_json.at("public_key"));
-    std::istringstream pubiss(pubkey_str);
-    Serial::Deserialize(publicKey_, pubiss, SerType::BINARY);
     // TODO: have other function for this
     // bind_inputs_to_data(seed_data);
 }
 
+void FHEComputation::load_evalmult_key(const std::string &serialized)
+{
+    evalmult_key_ = EvalKeyRegistry::instance().acquire(serialized, publicKey_->GetKeyTag());
+    evalmult_key_digest_ = evalmult_key_->digest_;
+
+    // relinearizing in the proof system finds the keys by the tag of the ciphertext, the tag of the public key
+    // may be claimed by other keys
+    for (auto &c : ciphertexts_)
+    {
+        if (c->GetKeyTag() != publicKey_->GetKeyTag())
+        {
+            throw std::invalid_argument("Ciphertext was not encrypted with the public key of the computation.");
+        }
+        c->SetKeyTag(evalmult_key_->eval_tag_);
+    }
+}
+
+Ciphertext<DCRTPoly> FHEComputation::untag(Ciphertext<DCRTPoly> c) const
+{
+    if (!evalmult_key_ || c->GetKeyTag() == publicKey_->GetKeyTag())
+    {
+        return c;
+    }
+    // with nothing evaluated the result is an input, which keeps its tag
+    if (std::find(ciphertexts_.begin(), ciphertexts_.end(), c) != ciphertexts_.end())
+    {
+        c = c->Clone();
+    }
+    c->SetKeyTag(publicKey_->GetKeyTag());
+    return c;
+}
+
 CryptoContext<DCRTPoly> FHEComputation::GetCryptoContext()
 {
     // ciphertexts cannot be empty, so context will be the CC of the first
@@ -73,30 +115,56 @@ void FHEComputation::bind_inputs_to_data(const std::vector<unsigned char> &data)
     }
     auto cc = GetCryptoContext();
 
-    // buffer to hold a counter and the data to bind the computation with
-    // init counter bytes with 0
-    std::vector<unsigned char> counter_and_data(sizeof(std::size_t), 0);
-    counter_and_data.resize(data.size() + sizeof(std::size_t));
-
-    // copy data to buffer after the counter bytes
-    std::copy(data.begin(), data.end(), counter_and_data.begin() + sizeof(std::size_t));
-
-    for (std::size_t i = 0; i < ciphertexts_.size(); ++i)
+    // every ciphertext is independent, so contiguous ranges are bound concurrently. The data can be large
+    // (it is the serialized header), so there is one counter buffer per range instead of per ciphertext
+    auto &pool = ThreadPool::compute();
+    std::size_t width = pool.size();
+#ifdef MULTICORE
+    // the share of the thread budget of the caller, as the miner and the validator set it for libiop
+    width = std::min<std::size_t>(width, std::max(1, omp_get_max_threads()));
+#endif
+    std::size_t chunks = std::min(ciphertexts_.size(), width);
+    std::size_t chunk_size = (chunks == 0) ? 0 : (ciphertexts_.size() + chunks - 1) / chunks;
+
+    TaskGroup group(pool);
+    for (std::size_t begin = 0; begin < ciphertexts_.size(); begin += chunk_size)
     {
-        std::memcpy(counter_and_data.data(), &i, sizeof(std::size_t));
-
-        auto zero = cc->EncryptZeroDeterministic(publicKey_, counter_and_data);
-        ciphertexts_[i] = cc->EvalAdd(zero, ciphertexts_[i]);
+        std::size_t end = std::min(begin + chunk_size, ciphertexts_.size());
+        group.run([this, &cc, &data, begin, end]()
+                  {
+            // buffer to hold a counter and the data to bind the computation with
+            // init counter bytes with 0
+            std::vector<unsigned char> counter_and_data(sizeof(std::size_t), 0);
+            counter_and_data.resize(data.size() + sizeof(std::size_t));
+
+            // copy data to buffer after the counter bytes
+            std::copy(data.begin(), data.end(), counter_and_data.begin() + sizeof(std::size_t));
+
+            for (std::size_t i = begin; i < end; ++i)
+            {
+                std::memcpy(counter_and_data.data(), &i, sizeof(std::size_t));
+
+                // the randomness comes from a generator seeded with counter_and_data alone, and OpenFHE keeps generator
+                // state per thread, so concurrent encryptions draw what a single one would (see bench check binding)
+                auto zero = cc->EncryptZeroDeterministic(publicKey_, counter_and_data);
+                if (evalmult_key_)
+                {
+                    zero->SetKeyTag(evalmult_key_->eval_tag_);
+                }
+                ciphertexts_[i] = cc->EvalAdd(zero, ciphertexts_[i]);
+            } });
     }
+    group.wait();
 }
 
-std::vector<unsigned char> FHEComputation::serialize()
+void FHEComputation::serialize_to(util::ByteSink &sink) const
 {
     // Output will be prepended, along with its size
     // Serialized computation will be:
     // - Timestamp
     // - Expression size
     // - Expression
+    // - CSE flag (1 byte), only when set, so computations without it keep their bytes
     // - Public key size
     // - Public key
     // - EvalMultKey sizes
@@ -105,42 +173,40 @@ std::vector<unsigned char> FHEComputation::serialize()
     // - For each ciphertext:
     //   - Ciphertext size
     //   - Ciphertext
+    static const std::string empty;
 
-    std::vector<unsigned char> res(util::uint64_to_vector_big_endian(timestamp_));
-
-    auto expr_size = util::uint64_to_vector_big_endian(expression_.size());
-    res.insert(res.end(), expr_size.begin(), expr_size.end());
-    res.insert(res.end(), expression_.begin(), expression_.end());
-
-    std::ostringstream pubos;
-    Serial::Serialize(publicKey_, pubos, SerType::BINARY);
-    auto pubos_str = pubos.str();
-    auto pubos_size = util::uint64_to_vector_big_endian(pubos_str.size());
-    res.insert(res.end(), pubos_size.begin(), pubos_size.end());
-    res.insert(res.end(), pubos_str.begin(), pubos_str.end());
-
-    std::ostringstream evos;
-    GetCryptoContext()->SerializeEvalMultKey(evos, SerType::BINARY);
-    auto evos_str = evos.str();
-    auto evos_size = util::uint64_to_vector_big_endian(evos_str.size());
-    res.insert(res.end(), evos_size.begin(), evos_size.end());
-    res.insert(res.end(), evos_str.begin(), evos_str.end());
+    sink.write_uint64(timestamp_);
+    sink.write_sized(expression_);
+    if (cse_)
+    {
+        const unsigned char cse = 1;
+        sink.write(&cse, 1);
+    }
 
-    auto count = util::uint64_to_vector_big_endian(ciphertexts_.size());
-    res.insert(res.end(), count.begin(), count.end());
+    // the keys and the unbound ciphertexts as received, so they are never serialized again
+    sink.write_sized(*public_key_bytes_);
+    sink.write_sized(evalmult_key_ ? *evalmult_key_->serialized_ : empty);
 
-    // since serialization uses the unbound ciphertexts, get from archive if current ones are bound
-    auto c_vec = (is_bound_) ? unbound_ciphertexts_archive_ : ciphertexts_;
-    for (const auto &c : c_vec)
+    sink.write_uint64(ciphertext_bytes_.size());
+    for (const auto &c : ciphertext_bytes_)
     {
-        std::ostringstream oss;
-        Serial::Serialize(c, oss, SerType::BINARY);
-        auto oss_str = oss.str();
-        auto csize = util::uint64_to_vector_big_endian(oss_str.size());
-        res.insert(res.end(), csize.begin(), csize.end());
-        res.insert(res.end(), oss_str.begin(), oss_str.end());
+        sink.write_sized(*c);
     }
+}
+
+std::size_t FHEComputation::serialized_size() const
+{
+    util::SizeSink sink;
+    serialize_to(sink);
+    return sink.size();
+}
 
+std::vector<unsigned char> FHEComputation::serialize()
+{
+    std::vector<unsigned char> res;
+    res.reserve(serialized_size());
+    util::VectorSink sink(res);
+    serialize_to(sink);
     return res;
 }
 
@@ -152,9 +218,11 @@ FHEComputation FHEComputation::from_proto(const ProtoComputation &proto)
     comp.is_bound_ = false;
 
     comp.expression_ = proto.expression();
+    comp.cse_ = proto.cse();
 
-    std::istringstream pubiss(proto.public_key());
-    Serial::Deserialize(comp.publicKey_, pubiss, SerType::BINARY);
+    auto pubkey = PublicKeyCache::instance().get(proto.public_key());
+    comp.publicKey_ = pubkey->key_;
+    comp.public_key_bytes_ = pubkey->serialized_;
 
     // always assume protobuf carries unbound ciphertext
     // first deserialize ciphertexts to have CryptoContext available
@@ -165,12 +233,12 @@ FHEComputation FHEComputation::from_proto(const ProtoComputation &proto)
         Ciphertext<DCRTPoly> cipher;
         Serial::Deserialize(cipher, iss, SerType::BINARY);
         comp.ciphertexts_.push_back(cipher);
+        comp.ciphertext_bytes_.push_back(std::make_shared<const std::string>(c));
     }
 
     if (!proto.evalmult_key().empty())
     {
-        std::istringstream iss(proto.evalmult_key());
-        comp.GetCryptoContext()->DeserializeEvalMultKey(iss, SerType::BINARY);
+        comp.load_evalmult_key(proto.evalmult_key());
     }
 
     comp.timestamp_ = proto.timestamp();
@@ -1,73 +1,124 @@
 #include "sodium.h"
 
 #include "util/util.hpp"
+#include "util/thread_pool.hpp"
 #include "computer/fhe_computer.hpp"
+#include "computer/fractal_index_cache.hpp"
 
 #include "core/block_header.hpp"
 
+#include <chrono>
+#include <functional>
+#include <mutex>
+
 using json = nlohmann::json;
 
 FHEComputer::FHEComputer(const json &comp_json) : computation_(std::make_shared<FHEComputation>(comp_json)),
-                                                  ast_(std::make_unique<ASTree>(computation_->expression_)),
+                                                  ast_(std::make_unique<ASTree>(computation_->expression_, computation_->cse_)),
                                                   last_res_(nullptr), has_hash_(false)
 {
+    schedule_program();
 }
 
-FHEComputer::FHEComputer(std::shared_ptr<FHEComputation> computation) : computation_(computation), ast_(std::make_unique<ASTree>(computation_->expression_)), last_res_(nullptr), has_hash_(false)
+FHEComputer::FHEComputer(std::shared_ptr<FHEComputation> computation) : computation_(computation), ast_(std::make_unique<ASTree>(computation_->expression_, computation_->cse_)), last_res_(nullptr), has_hash_(false)
 {
+    schedule_program();
 }
 
 Ciphertext<DCRTPoly> FHEComputer::evaluate()
 {
 
-    // simple evaluation will use CryptoContext
+    // simple evaluation will use CryptoContext, independent subtrees run concurrently
 
-    last_res_ = eval(ast_->root_, true);
+    last_res_ = eval_parallel();
     return last_res_;
 }
 
+namespace
+{
+    double ms_since(std::chrono::steady_clock::time_point start)
+    {
+        return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::mutex timings_mu;
+    ComputationTimings timings_total;
+    std::size_t proofs_timed = 0;
+
+    bool same_shape(const Ciphertext<DCRTPoly> &a, const Ciphertext<DCRTPoly> &b)
+    {
+        if (!a || !b || a->NumberCiphertextElements() != b->NumberCiphertextElements())
+        {
+            return false;
+        }
+        for (std::size_t i = 0; i < a->NumberCiphertextElements(); ++i)
+        {
+            const auto &x = a->GetElements()[i];
+            const auto &y = b->GetElements()[i];
+            if (x.GetNumOfElements() != y.GetNumOfElements() || x.GetRingDimension() != y.GetRingDimension())
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
 void FHEComputer::generate_constraints(bool eval_output)
 {
+    auto start = std::chrono::steady_clock::now();
     // NOTE: for some reason it's satisfied only with (0+1)*(0-1)
     ps_ = std::make_unique<LibsnarkProofSystem>(computation_->GetCryptoContext());
-    Ciphertext<DCRTPoly> out_ctxt;
+    ps_->SetMode(PROOFSYSTEM_MODE::PROOFSYSTEM_MODE_CONSTRAINT_GENERATION);
+    init_public_input();
+    io_layout_.num_inputs = ps_->pb.num_variables();
+
+    // The proof system computes every ciphertext it constrains, so the traversal also produces the output.
+    // The public output is allocated after the circuit instead of before it, and moved next to the inputs
+    // when converting (see PublicOutputLayout).
+    auto out_ctxt = eval(false);
     if (eval_output)
     {
         // this case will be used for proof generation
         // result of this is also saved to last_res_, so it will be included in the transmitted block
-        out_ctxt = evaluate();
+        last_res_ = out_ctxt;
     }
-    else
+
+    // for proof verification the public output is the claimed one, any part of it the computed one does not
+    // have would be left unconstrained
+    if (!eval_output && !same_shape(out_ctxt, last_res_))
     {
-        // this will be used for proof verification
-        out_ctxt = last_res_;
+        throw std::invalid_argument("Claimed output does not have the shape of the computed one.");
     }
-
-    ps_->SetMode(PROOFSYSTEM_MODE::PROOFSYSTEM_MODE_CONSTRAINT_GENERATION);
-    seen_.clear();
-    init_public_input(ast_->root_);
-    auto vars_out = *(ps_->ConstrainPublicOutput(out_ctxt));
-    out_ctxt = eval(ast_->root_, false);
+    io_layout_.first_output = ps_->pb.num_variables();
+    auto vars_out = *(ps_->ConstrainPublicOutput(last_res_));
+    io_layout_.num_outputs = ps_->pb.num_variables() - io_layout_.first_output;
     ps_->FinalizeOutputConstraints(out_ctxt, vars_out);
 
     const r1cs_constraint_system<FieldT> constraint_system = ps_->pb.get_constraint_system();
 
-    cout << "#inputs:      " << constraint_system.num_inputs() << endl;
+    cout << "#inputs:      " << io_layout_.num_inputs + io_layout_.num_outputs << endl;
     cout << "#variables:   " << constraint_system.num_variables() << endl;
     cout << "#constraints: " << constraint_system.num_constraints() << endl;
-    cout << "#aux: " << ps_->pb.auxiliary_input().size() << endl;
+    cout << "#aux: " << constraint_system.num_variables() - io_layout_.num_inputs - io_layout_.num_outputs << endl;
+
+    const auto &report = ast_->schedule_report_;
+    cout << "#relinearizations: " << report.relins << " (unscheduled: " << report.naive_relins << ")" << endl;
+    cout << "#rescales:         " << report.rescales << " (unscheduled: " << report.naive_rescales << ")" << endl;
 
+    // satisfaction only depends on the full assignment, not on where the public part ends
     bool satisfied = constraint_system.is_satisfied(ps_->pb.primary_input(), ps_->pb.auxiliary_input());
     cout << "satisfied:    " << std::boolalpha << satisfied << endl;
+
+    timings_.constraints_ms = ms_since(start);
 }
 
 void FHEComputer::generate_witness()
 {
     ps_->SetMode(PROOFSYSTEM_MODE::PROOFSYSTEM_MODE_WITNESS_GENERATION);
-    seen_.clear();
-    init_public_input(ast_->root_);
+    init_public_input();
     // NOTE: maybe incorrect
-    auto out_ctxt = eval(ast_->root_, false);
+    auto out_ctxt = eval(false);
 
     const auto pb = ps_->pb;
 
@@ -82,106 +133,119 @@ void FHEComputer::generate_witness()
     cout << "satisfied:    " << std::boolalpha << satisfied << endl;
 }
 
-libiop::aurora_snark_argument<FieldT, hash_type> FHEComputer::generate_argument()
-{
-    const size_t security_parameter = 128;
-    const size_t RS_extra_dimensions = 2;
-    const size_t FRI_localization_parameter = 3;
-    const libiop::LDT_reducer_soundness_type ldt_reducer_soundness_type = libiop::LDT_reducer_soundness_type::optimistic_heuristic;
-    const libiop::FRI_soundness_type fri_soundness_type = libiop::FRI_soundness_type::heuristic;
-    const libiop::field_subset_type domain_type = libiop::affine_subspace_type;
-    const bool make_zk = false;
-
-    libiop::r1cs_constraint_system<FieldT> liop_cs;
-    libsnark_to_libiop_r1cs_constraint_system(ps_->pb.get_constraint_system(), liop_cs);
-    std::cout << "Just converted to libiop constraint system:" << std::endl;
-    cout << "#inputs:      " << liop_cs.num_inputs() << endl;
-    cout << "#variables:   " << liop_cs.num_variables() << endl;
-    cout << "#constraints: " << liop_cs.num_constraints() << endl;
-
-    pad_constraint_system_for_aurora(liop_cs);
-    std::cout << "Padding libiop constraint system:" << std::endl;
-    cout << "#inputs:      " << liop_cs.num_inputs() << endl;
-    cout << "#variables:   " << liop_cs.num_variables() << endl;
-    cout << "#constraints: " << liop_cs.num_constraints() << endl;
-
-    libiop::r1cs_primary_input<FieldT> cs_primary_input = ps_->pb.primary_input();
-    libiop::r1cs_auxiliary_input<FieldT> cs_auxiliary_input = ps_->pb.auxiliary_input();
-
-    pad_primary_input_to_match_cs(liop_cs, cs_primary_input);
-    pad_auxiliary_input_to_match_cs(liop_cs, cs_auxiliary_input);
-
-    libiop::aurora_snark_parameters<FieldT, hash_type> params(
-        security_parameter,
-        ldt_reducer_soundness_type,
-        fri_soundness_type,
-        libiop::blake2b_type,
-        FRI_localization_parameter,
-        RS_extra_dimensions,
-        make_zk,
-        domain_type,
-        liop_cs.num_constraints(),
-        liop_cs.num_variables());
-
-    const libiop::aurora_snark_argument<FieldT, hash_type> argument = aurora_snark_prover<FieldT>(
-        liop_cs,
-        cs_primary_input,
-        cs_auxiliary_input,
-        params);
-
-    printf("iop size in bytes %lu\n", argument.IOP_size_in_bytes());
-    printf("bcs size in bytes %lu\n", argument.BCS_size_in_bytes());
-    printf("argument size in bytes %lu\n", argument.size_in_bytes());
-
-    return argument;
-}
-
-bool FHEComputer::verify_argument(const libiop::aurora_snark_argument<FieldT, hash_type> &argument)
-{
-    const size_t security_parameter = 128;
-    const size_t RS_extra_dimensions = 2;
-    const size_t FRI_localization_parameter = 3;
-    const libiop::LDT_reducer_soundness_type ldt_reducer_soundness_type = libiop::LDT_reducer_soundness_type::optimistic_heuristic;
-    const libiop::FRI_soundness_type fri_soundness_type = libiop::FRI_soundness_type::heuristic;
-    const libiop::field_subset_type domain_type = libiop::affine_subspace_type;
-    const bool make_zk = false;
-
-    libiop::r1cs_constraint_system<FieldT> liop_cs;
-    libsnark_to_libiop_r1cs_constraint_system(ps_->pb.get_constraint_system(), liop_cs);
-    std::cout << "Just converted to libiop constraint system:" << std::endl;
-    cout << "#inputs:      " << liop_cs.num_inputs() << endl;
-    cout << "#variables:   " << liop_cs.num_variables() << endl;
-    cout << "#constraints: " << liop_cs.num_constraints() << endl;
-
-    pad_constraint_system_for_aurora(liop_cs);
-    std::cout << "Padding libiop constraint system:" << std::endl;
-    cout << "#inputs:      " << liop_cs.num_inputs() << endl;
-    cout << "#variables:   " << liop_cs.num_variables() << endl;
-    cout << "#constraints: " << liop_cs.num_constraints() << endl;
-
-    libiop::r1cs_primary_input<FieldT> cs_primary_input = ps_->pb.primary_input();
-    libiop::r1cs_auxiliary_input<FieldT> cs_auxiliary_input = ps_->pb.auxiliary_input();
-
-    pad_primary_input_to_match_cs(liop_cs, cs_primary_input);
-    pad_auxiliary_input_to_match_cs(liop_cs, cs_auxiliary_input);
-
-    libiop::aurora_snark_parameters<FieldT, hash_type> params(
-        security_parameter,
-        ldt_reducer_soundness_type,
-        fri_soundness_type,
-        libiop::blake2b_type,
-        FRI_localization_parameter,
-        RS_extra_dimensions,
-        make_zk,
-        domain_type,
-        liop_cs.num_constraints(),
-        liop_cs.num_variables());
-
-    return aurora_snark_verifier<FieldT, hash_type>(
-        liop_cs,
-        cs_primary_input,
-        argument,
-        params);
+std::shared_ptr<const R1CSCache::Circuit> FHEComputer::constraint_system()
+{
+    auto key = shape_key();
+    auto cached = R1CSCache::instance().get(key);
+    if (cached)
+    {
+        return cached;
+    }
+
+    auto circuit = std::make_shared<R1CSCache::Circuit>();
+    auto ls_cs = ps_->pb.get_constraint_system();
+    auto constraints_before = ls_cs.num_constraints();
+    auto variables_before = ls_cs.num_variables();
+
+    // deterministic, so the prover and the verifier end up with the same system
+    optimize_r1cs_constraint_system(ls_cs, io_layout_, circuit->kept_aux_);
+    std::cout << "Optimized constraint system:" << std::endl;
+    cout << "#constraints: " << constraints_before << " -> " << ls_cs.num_constraints() << endl;
+    cout << "#variables:   " << variables_before << " -> " << ls_cs.num_variables() << endl;
+
+    circuit->num_constraints_ = ls_cs.num_constraints();
+    circuit->num_inputs_ = ls_cs.num_inputs();
+
+    // public variables are already first
+    PublicOutputLayout identity{ls_cs.num_inputs(), ls_cs.num_inputs(), 0};
+    libsnark_to_padded_libiop_r1cs_constraint_system(ls_cs, circuit->cs_, identity);
+    std::cout << "Converted to padded libiop constraint system:" << std::endl;
+    cout << "#inputs:      " << circuit->cs_.num_inputs() << endl;
+    cout << "#variables:   " << circuit->cs_.num_variables() << endl;
+    cout << "#constraints: " << circuit->cs_.num_constraints() << endl;
+
+    R1CSCache::instance().put(key, circuit);
+    return circuit;
+}
+
+std::vector<unsigned char> FHEComputer::shape_key()
+{
+    if (!shape_key_.empty())
+    {
+        return shape_key_;
+    }
+
+    crypto_generichash_state state;
+    crypto_generichash_init(&state, nullptr, 0, crypto_generichash_BYTES);
+    auto update = [&state](uint64_t val)
+    {
+        auto bytes = util::uint64_to_vector_big_endian(val);
+        crypto_generichash_update(&state, bytes.data(), bytes.size());
+    };
+
+    // balanced and scheduled program
+    update(ast_->program_.size());
+    for (const auto &instr : ast_->program_)
+    {
+        update(static_cast<uint64_t>(instr.op_));
+        update(instr.left_);
+        update(instr.right_);
+        update(static_cast<uint32_t>(instr.val_));
+        update(static_cast<uint32_t>(instr.depth_));
+    }
+
+    // ring dimension, modulus chain and key switching
+    auto cc = GetCryptoContext();
+    auto crypto_params = cc->GetCryptoParameters();
+    update(cc->GetRingDimension());
+    update(crypto_params->GetPlaintextModulus());
+    auto rns_params = std::dynamic_pointer_cast<CryptoParametersRNS>(crypto_params);
+    update(rns_params ? static_cast<uint64_t>(rns_params->GetKeySwitchTechnique()) : UINT64_MAX);
+    const auto &moduli = crypto_params->GetElementParams()->GetParams();
+    update(moduli.size());
+    for (const auto &p : moduli)
+    {
+        update(p->GetModulus().ConvertToInt());
+    }
+
+    // the inputs determine the size of the public input
+    update(computation_->ciphertexts_.size());
+    for (const auto &c : computation_->ciphertexts_)
+    {
+        update(c->NumberCiphertextElements());
+        update(c->GetLevel());
+        update(c->GetElements()[0].GetNumOfElements());
+    }
+
+    // and so does the output, which the verifier takes from the claim
+    if (!last_res_)
+    {
+        throw std::logic_error("Shape key needs the output of the computation.");
+    }
+    update(last_res_->NumberCiphertextElements());
+    for (const auto &e : last_res_->GetElements())
+    {
+        update(e.GetNumOfElements());
+        update(e.GetRingDimension());
+    }
+
+    // relinearization keys appear as constants in the constraints
+    crypto_generichash_update(&state, computation_->evalmult_key_digest_.data(), computation_->evalmult_key_digest_.size());
+
+    shape_key_.resize(crypto_generichash_BYTES);
+    crypto_generichash_final(&state, shape_key_.data(), shape_key_.size());
+    return shape_key_;
+}
+
+void FHEComputer::assign_public_io()
+{
+    ps_ = std::make_unique<LibsnarkProofSystem>(computation_->GetCryptoContext());
+    ps_->SetMode(PROOFSYSTEM_MODE::PROOFSYSTEM_MODE_CONSTRAINT_GENERATION);
+    // without the circuit the outputs directly follow the inputs
+    init_public_input();
+    io_layout_.num_inputs = io_layout_.first_output = ps_->pb.num_variables();
+    ps_->ConstrainPublicOutput(last_res_);
+    io_layout_.num_outputs = ps_->pb.num_variables() - io_layout_.first_output;
 }
 
 // void FHEComputer::generate_constraints()
@@ -218,75 +282,159 @@ bool FHEComputer::verify_argument(const libiop::aurora_snark_argument<FieldT, ha
 //     cout << "satisfied:    " << std::boolalpha << satisfied << endl;
 // }
 
-Ciphertext<DCRTPoly> FHEComputer::eval(std::shared_ptr<ASTNode> &node, bool eval_mode)
+void FHEComputer::prepare_constants()
 {
-    if (stop_flag_ && *stop_flag_)
+    auto cc = GetCryptoContext();
+    int64_t t = cc->GetCryptoParameters()->GetPlaintextModulus();
+    for (const auto &instr : ast_->program_)
     {
-        throw std::out_of_range("stop flag");
+        if ((instr.op_ != ASTOp::AddPlain && instr.op_ != ASTOp::MulPlain) || constants_.count(instr.val_))
+        {
+            continue;
+        }
+
+        // centered representative, as packed plaintexts expect. A constant polynomial has the same value
+        // in every slot
+        int64_t val = ((instr.val_ % t) + t) % t;
+        if (val > t / 2)
+        {
+            val -= t;
+        }
+        constants_[instr.val_] = cc->MakeCoefPackedPlaintext({val});
     }
+}
+
+Ciphertext<DCRTPoly> FHEComputer::eval(bool eval_mode)
+{
+    prepare_constants();
 
-    // leaves correspond to ciphertexts as given in the original computation
-    if (node->is_leaf)
+    const auto &program = ast_->program_;
+    std::vector<Ciphertext<DCRTPoly>> values(program.size());
+
+    // program is in post order, so operands are always available when an instruction is reached
+    for (std::size_t i = 0; i < program.size(); ++i)
     {
-        // return computation_->ciphertexts_.at(node->val_)->Clone();
-        return computation_->ciphertexts_.at(node->val_);
+        if (stop_flag_ && *stop_flag_)
+        {
+            throw std::out_of_range("stop flag");
+        }
+
+        const auto &instr = program[i];
+        if (instr.op_ == ASTOp::Leaf)
+        {
+            // leaves correspond to ciphertexts as given in the original computation
+            values[i] = computation_->ciphertexts_.at(instr.val_);
+            continue;
+        }
+        auto c_right = (instr.right_ != AST_NONE) ? values[instr.right_] : nullptr;
+        values[i] = apply_op(instr, values[instr.left_], c_right, eval_mode);
     }
 
-    // if not leaf, then node should have both children
-    if (!node->left_child_ || !node->right_child_)
+    return computation_->untag(values.back());
+}
+
+Ciphertext<DCRTPoly> FHEComputer::eval_parallel()
+{
+    const auto &program = ast_->program_;
+    if (program.size() == 1)
     {
-        throw std::runtime_error("Internal ASTNode should have both chldren.");
+        return eval(true);
     }
 
-    // collect results from lower level
-    auto c_left = eval(node->left_child_, eval_mode);
-    auto c_right = eval(node->right_child_, eval_mode);
+    // Turn the program into a task graph. Every instruction becomes a task that is released once all of
+    // its operands are available, so independent subtrees are evaluated concurrently and the wall time
+    // follows the critical path of the circuit. Each task always applies the same operation to the same
+    // operands, so the result does not depend on the schedule. Instructions shared after CSE are one
+    // task with several users.
+    // plaintexts are only read by the tasks
+    prepare_constants();
 
-    auto left_depth = node->left_child_->depth_;
-    auto right_depth = node->right_child_->depth_;
+    std::vector<Ciphertext<DCRTPoly>> values(program.size());
+    std::vector<std::vector<uint32_t>> users(program.size());
+    std::unique_ptr<std::atomic<int>[]> pending(new std::atomic<int>[program.size()]);
 
-    // bring both children ciphertexts to the same level
-    auto depth_diff = left_depth - right_depth;
-    if (depth_diff != 0)
+    for (std::size_t i = 0; i < program.size(); ++i)
     {
-        auto &target = (depth_diff > 0) ? c_right : c_left;
-        depth_diff = std::abs(depth_diff);
-        while (depth_diff--)
+        const auto &instr = program[i];
+        pending[i] = 0;
+        if (instr.op_ == ASTOp::Leaf)
         {
-            if (eval_mode)
+            values[i] = computation_->ciphertexts_.at(instr.val_);
+            continue;
+        }
+
+        for (auto operand : {instr.left_, instr.right_})
+        {
+            // an instruction using the same operand twice only waits for it once
+            if (operand == AST_NONE || program[operand].op_ == ASTOp::Leaf || (operand == instr.right_ && instr.left_ == instr.right_))
             {
-                target = GetCryptoContext()->Relinearize(target);
-                target = GetCryptoContext()->Rescale(target);
+                continue;
             }
-            else
+            users[operand].push_back(i);
+            ++pending[i];
+        }
+    }
+
+    TaskGroup group(ThreadPool::compute());
+    std::function<void(uint32_t)> run_task = [&](uint32_t idx)
+    {
+        if (stop_flag_ && *stop_flag_)
+        {
+            throw std::out_of_range("stop flag");
+        }
+
+        const auto &instr = program[idx];
+        auto c_right = (instr.right_ != AST_NONE) ? values[instr.right_] : nullptr;
+        values[idx] = apply_op(instr, values[instr.left_], c_right, true);
+
+        // the last operand to finish releases the user
+        for (auto user : users[idx])
+        {
+            if (--pending[user] == 0)
             {
-                target = ps_->Relinearize(target);
-                target = ps_->Rescale(target);
+                group.run([&run_task, user]()
+                          { run_task(user); });
             }
         }
+    };
+
+    for (uint32_t i = 0; i < program.size(); ++i)
+    {
+        if (program[i].op_ != ASTOp::Leaf && pending[i] == 0)
+        {
+            group.run([&run_task, i]()
+                      { run_task(i); });
+        }
     }
 
-    if (node->op_ == "+")
+    // rethrows the first failure, including the stop flag
+    group.wait();
+
+    return computation_->untag(values.back());
+}
+
+Ciphertext<DCRTPoly> FHEComputer::apply_op(const ASTInstr &instr, Ciphertext<DCRTPoly> c_left, Ciphertext<DCRTPoly> c_right, bool eval_mode)
+{
+    // operands are already at the same level, the scheduling pass emitted the Relin and Rescale
+    // instructions needed for that
+    switch (instr.op_)
     {
-        std::cout << "+" << std::endl;
+    case ASTOp::Add:
         if (eval_mode)
         {
             return GetCryptoContext()->EvalAdd(c_left, c_right);
         }
         return ps_->EvalAdd(c_left, c_right);
-    }
-    else if (node->op_ == "-")
-    {
-        std::cout << "-" << std::endl;
+
+    case ASTOp::Sub:
         if (eval_mode)
         {
             return GetCryptoContext()->EvalSub(c_left, c_right);
         }
         return ps_->EvalSub(c_left, c_right);
-    }
-    else if (node->op_ == "*")
+
+    case ASTOp::Mul:
     {
-        std::cout << "*" << std::endl;
         if (eval_mode)
         {
             auto c_res = GetCryptoContext()->EvalMultNoRelin(c_left, c_right);
@@ -295,35 +443,79 @@ Ciphertext<DCRTPoly> FHEComputer::eval(std::shared_ptr<ASTNode> &node, bool eval
         auto c_mult = ps_->EvalMultNoRelin(c_left, c_right);
         return c_mult;
     }
-    else
+
+    case ASTOp::AddPlain:
+        if (eval_mode)
+        {
+            return GetCryptoContext()->EvalAdd(c_left, constants_.at(instr.val_));
+        }
+        return ps_->EvalAdd(c_left, constants_.at(instr.val_));
+
+    case ASTOp::MulPlain:
+        if (eval_mode)
+        {
+            return GetCryptoContext()->EvalMult(c_left, constants_.at(instr.val_));
+        }
+        return ps_->EvalMult(c_left, constants_.at(instr.val_));
+
+    case ASTOp::Relin:
     {
+        if (!computation_->evalmult_key_)
+        {
+            throw std::invalid_argument("No EvalMultKey to relinearize with.");
+        }
+        if (eval_mode)
+        {
+            // with the keys of the computation, not the ones OpenFHE holds for the tag
+            return GetCryptoContext()->GetScheme()->Relinearize(c_left, computation_->evalmult_key_->keys_);
+        }
+        auto lock = EvalKeyRegistry::instance().lookup_lock();
+        return ps_->Relinearize(c_left);
+    }
+
+    case ASTOp::Rescale:
+        if (eval_mode)
+        {
+            return GetCryptoContext()->Rescale(c_left);
+        }
+        return ps_->Rescale(c_left);
+
+    default:
         throw std::invalid_argument("Invalid op in ASTNode.");
     }
 }
 
-void FHEComputer::init_public_input(std::shared_ptr<ASTNode> node)
+void FHEComputer::init_public_input()
 {
-    // leaves correspond to ciphertexts as given in the original computation
-    if (node->is_leaf)
+    // leaves correspond to ciphertexts as given in the original computation. They appear in the program
+    // in the same left to right order as in the tree
+    std::unordered_set<int> seen;
+    for (const auto &instr : ast_->program_)
     {
-        if (seen_.find(node->val_) == seen_.end())
+        if (instr.op_ != ASTOp::Leaf)
+        {
+            continue;
+        }
+
+        if (seen.find(instr.val_) == seen.end())
         {
             // if ciphertext input has not been seen before, declare as PublicInput and set as seen
-            ps_->PublicInput(computation_->ciphertexts_.at(node->val_));
-            seen_.insert(node->val_);
+            ps_->PublicInput(computation_->ciphertexts_.at(instr.val_));
+            seen.insert(instr.val_);
         }
-        return;
     }
+}
 
-    // if not leaf, then node should have both children
-    if (!node->left_child_ || !node->right_child_)
+void FHEComputer::schedule_program()
+{
+    // the leaves start at the degree of the submitted ciphertexts, normally 2
+    std::vector<uint32_t> input_degrees;
+    input_degrees.reserve(computation_->ciphertexts_.size());
+    for (const auto &c : computation_->ciphertexts_)
     {
-        throw std::runtime_error("Internal ASTNode should have both chldren.");
+        input_degrees.push_back(c->NumberCiphertextElements());
     }
-
-    // collect results from lower level
-    init_public_input(node->left_child_);
-    init_public_input(node->right_child_);
+    ast_->schedule(input_degrees);
 }
 
 CryptoContext<DCRTPoly> FHEComputer::GetCryptoContext()
@@ -333,7 +525,9 @@ CryptoContext<DCRTPoly> FHEComputer::GetCryptoContext()
 
 void FHEComputer::bind_to_data(const std::vector<unsigned char> &data)
 {
+    auto start = std::chrono::steady_clock::now();
     computation_->bind_inputs_to_data(data);
+    timings_.bind_ms = ms_since(start);
 }
 
 std::vector<unsigned char> FHEComputer::proof()
@@ -350,61 +544,215 @@ void FHEComputer::generate_proof()
 {
     // note: here, apart from the constraints, a witness should be called, but because of zkOpenFHE having
     // an issue with this, we're using just constraint generation, which inadvertently generates a witness
+    auto start = std::chrono::steady_clock::now();
+    libiop::r1cs_primary_input<FieldT> cs_primary_input;
+    libiop::r1cs_auxiliary_input<FieldT> cs_auxiliary_input;
+    auto circuit = prove_circuit(cs_primary_input, cs_auxiliary_input);
+
+    pad_primary_input_to_match_cs(circuit->cs_, cs_primary_input);
+    pad_auxiliary_input_to_match_cs(circuit->cs_, cs_auxiliary_input);
+
+    backend_ = ProofBackendPolicy::instance().select(circuit->cs_.num_constraints());
+    std::cout << "Proving with " << ProofBackend::name(backend_) << std::endl;
+    // preprocessing backends index the circuit by its shape, validators look the index up with it
+    proof_shape_id_ = (backend_ == ProofBackendType::Fractal) ? shape_key() : std::vector<unsigned char>();
+    proof_ = ProofBackend::get(backend_).prove(shape_key(), circuit->cs_, cs_primary_input, cs_auxiliary_input);
+
+    timings_.prove_ms = ms_since(start) - timings_.constraints_ms;
+    record_timings(timings_);
+}
+
+void FHEComputer::record_timings(const ComputationTimings &timings)
+{
+    std::lock_guard<std::mutex> lg(timings_mu);
+    timings_total.bind_ms += timings.bind_ms;
+    timings_total.constraints_ms += timings.constraints_ms;
+    timings_total.prove_ms += timings.prove_ms;
+    ++proofs_timed;
+}
+
+json FHEComputer::timing_totals()
+{
+    std::lock_guard<std::mutex> lg(timings_mu);
+    return {{"proofs", proofs_timed}, {"bind_ms", timings_total.bind_ms}, {"constraints_ms", timings_total.constraints_ms}, {"prove_ms", timings_total.prove_ms}};
+}
+
+std::shared_ptr<const R1CSCache::Circuit> FHEComputer::verifier_circuit()
+{
+    // for a known shape there is no need to run the circuit through the proof system
+    auto circuit = R1CSCache::instance().get(shape_key());
+    if (circuit)
+    {
+        assign_public_io();
+        return circuit;
+    }
+
+    generate_constraints(false);
+    return constraint_system();
+}
+
+const PublicOutputLayout &FHEComputer::io_layout() const
+{
+    return io_layout_;
+}
+
+std::shared_ptr<const R1CSCache::Circuit> FHEComputer::prove_circuit(libiop::r1cs_primary_input<FieldT> &primary, libiop::r1cs_auxiliary_input<FieldT> &aux)
+{
     generate_constraints(true);
+    auto circuit = constraint_system();
 
-    auto arg = generate_argument();
-    std::ostringstream oss;
-    arg.serialize(oss);
-    auto st = oss.str();
+    split_assignment(ps_->pb.full_variable_assignment(), io_layout_, primary, aux);
+    compact_auxiliary_input(aux, circuit->kept_aux_);
+    return circuit;
+}
 
-    proof_.assign(st.begin(), st.end());
-    // proof_ = std::vector<unsigned char>(st.begin(), st.end());
+std::shared_ptr<const R1CSCache::Circuit> FHEComputer::verify_circuit(libiop::r1cs_primary_input<FieldT> &primary)
+{
+    if (!last_res_)
+    {
+        std::cout << "No claimed output to verify." << std::endl;
+        return nullptr;
+    }
+    std::shared_ptr<const R1CSCache::Circuit> circuit;
+    try
+    {
+        circuit = verifier_circuit();
+    }
+    catch (const std::invalid_argument &e)
+    {
+        std::cout << e.what() << std::endl;
+        return nullptr;
+    }
+    // the inputs and the claimed output must fill the public input of the circuit exactly
+    if (io_layout_.num_inputs + io_layout_.num_outputs != circuit->num_inputs_)
+    {
+        std::cout << "Public input does not match the circuit." << std::endl;
+        return nullptr;
+    }
+
+    libiop::r1cs_auxiliary_input<FieldT> aux;
+    split_assignment(ps_->pb.full_variable_assignment(), io_layout_, primary, aux);
+    return circuit;
 }
 
 bool FHEComputer::verify_proof(const std::vector<unsigned char> &proof)
 {
+    if (!last_res_)
+    {
+        std::cout << "No claimed output to verify." << std::endl;
+        return false;
+    }
+    if (!proof_shape_id_.empty() && proof_shape_id_ != shape_key())
+    {
+        std::cout << "Proof was made for another circuit shape." << std::endl;
+        return false;
+    }
 
-    generate_constraints(false);
+    // the verifier only needs the primary input
+    libiop::r1cs_primary_input<FieldT> cs_primary_input;
+
+    // an indexed Fractal shape is verified against its index, without its constraints or the circuit
+    if (backend_ == ProofBackendType::Fractal)
+    {
+        auto indexed = FractalIndexCache::instance().find_verifier(shape_key());
+        if (indexed)
+        {
+            assign_public_io();
+            // the index keeps the padded system, its inputs are padded to a power of two minus one
+            auto num_public = io_layout_.num_inputs + io_layout_.num_outputs;
+            if ((std::size_t(1) << libff::log2(num_public + 1)) - 1 != indexed->cs_->num_inputs())
+            {
+                std::cout << "Public input does not match the circuit." << std::endl;
+                return false;
+            }
+
+            libiop::r1cs_auxiliary_input<FieldT> aux;
+            split_assignment(ps_->pb.full_variable_assignment(), io_layout_, cs_primary_input, aux);
+            pad_primary_input_to_match_cs(*indexed->cs_, cs_primary_input);
+            return ProofBackend::get(backend_).verify(shape_key(), *indexed->cs_, cs_primary_input, proof);
+        }
+    }
 
-    libiop::aurora_snark_argument<FieldT, hash_type> arg;
-    std::string s(proof.begin(), proof.end());
-    std::istringstream iss(std::move(s));
-    arg.deserialize(iss);
-    return verify_argument(arg);
+    auto circuit = verify_circuit(cs_primary_input);
+    if (!circuit)
+    {
+        return false;
+    }
+    pad_primary_input_to_match_cs(circuit->cs_, cs_primary_input);
+
+    return ProofBackend::get(backend_).verify(shape_key(), circuit->cs_, cs_primary_input, proof);
 }
 
 uint32_t FHEComputer::difficulty()
 {
-    return ast_->root_->depth_;
+    return ast_->depth();
 }
 
-std::vector<unsigned char> FHEComputer::output()
+CostEstimate FHEComputer::estimate_cost()
+{
+    if (!has_cost_)
+    {
+        cost_ = CostModel::instance().estimate(ast_->program_, GetCryptoContext(), computation_->ciphertexts_);
+        has_cost_ = true;
+    }
+    return cost_;
+}
+
+const std::string &FHEComputer::output_bytes()
 {
     if (!last_res_)
     {
-        last_res_ = eval(ast_->root_, true);
+        last_res_ = eval_parallel();
     }
 
-    std::ostringstream oss;
-    Serial::Serialize(last_res_, oss, SerType::BINARY);
-    auto oss_str = oss.str();
-    return std::vector<unsigned char>(oss_str.begin(), oss_str.end());
+    // serialized once per result
+    if (!output_bytes_ || output_bytes_of_ != last_res_)
+    {
+        std::ostringstream oss;
+        Serial::Serialize(last_res_, oss, SerType::BINARY);
+        output_bytes_ = std::make_shared<const std::string>(oss.str());
+        output_bytes_of_ = last_res_;
+    }
+    return *output_bytes_;
 }
 
-std::vector<unsigned char> FHEComputer::serialize(bool include_output)
+std::vector<unsigned char> FHEComputer::output()
+{
+    const auto &out = output_bytes();
+    return std::vector<unsigned char>(out.begin(), out.end());
+}
+
+void FHEComputer::serialize_to(util::ByteSink &sink, bool include_output)
 {
-    if (include_output)
+    if (!include_output)
     {
-        std::vector<unsigned char> res;
-        auto out = output();
-        auto csize = util::uint64_to_vector_big_endian(out.size());
-        res.insert(res.end(), csize.begin(), csize.end());
-        res.insert(res.end(), out.begin(), out.end());
-        auto compser = computation_->serialize();
-        res.insert(res.end(), compser.begin(), compser.end());
-        return res;
+        computation_->serialize_to(sink);
+        return;
     }
-    return computation_->serialize();
+
+    sink.write_sized(output_bytes());
+    computation_->serialize_to(sink);
+    // only tagged when not the default, so Aurora proven computations serialize as before
+    if (backend_ != ProofBackendType::Aurora)
+    {
+        sink.write_uint32(static_cast<uint32_t>(backend_));
+    }
+}
+
+std::size_t FHEComputer::serialized_size(bool include_output)
+{
+    util::SizeSink sink;
+    serialize_to(sink, include_output);
+    return sink.size();
+}
+
+std::vector<unsigned char> FHEComputer::serialize(bool include_output)
+{
+    std::vector<unsigned char> res;
+    res.reserve(serialized_size(include_output));
+    util::VectorSink sink(res);
+    serialize_to(sink, include_output);
+    return res;
 }
 
 std::vector<unsigned char> FHEComputer::serialize_for_hash()
@@ -418,22 +766,15 @@ std::vector<unsigned char> FHEComputer::hash()
     {
         return hash_;
     }
-
-    auto ser = serialize_for_hash();
-
-    hash_.resize(crypto_generichash_BYTES);
-    crypto_generichash(hash_.data(), crypto_generichash_BYTES, ser.data(), ser.size(), nullptr, 0);
-    has_hash_ = true;
-
-    return hash_;
+    return hash_force();
 }
 
 std::vector<unsigned char> FHEComputer::hash_force()
 {
-    auto ser = serialize_for_hash();
-
-    hash_.resize(crypto_generichash_BYTES);
-    crypto_generichash(hash_.data(), crypto_generichash_BYTES, ser.data(), ser.size(), nullptr, 0);
+    // same digest as hashing serialize_for_hash(), without building it
+    util::HashSink sink;
+    computation_->serialize_to(sink);
+    hash_ = sink.digest();
     has_hash_ = true;
 
     return hash_;
@@ -444,45 +785,48 @@ void FHEComputer::set_stop_flag(std::shared_ptr<std::atomic<bool>> stop_flag)
     stop_flag_ = stop_flag;
 }
 
+std::shared_ptr<std::atomic<bool>> FHEComputer::stop_flag() const
+{
+    return stop_flag_;
+}
+
 ProtoComputation FHEComputer::to_proto() const
 {
     ProtoComputation pc;
 
     pc.set_expression(computation_->expression_);
 
-    std::ostringstream pubos;
-    Serial::Serialize(computation_->publicKey_, pubos, SerType::BINARY);
-    auto pubos_str = pubos.str();
-    pc.set_public_key(pubos_str);
-
-    std::ostringstream evos;
-    computation_->GetCryptoContext()->SerializeEvalMultKey(evos, SerType::BINARY);
-    auto evos_str = evos.str();
-    pc.set_evalmult_key(evos_str);
+    // the buffers the computation arrived with, nothing is serialized again
+    pc.set_public_key(*computation_->public_key_bytes_);
+    if (computation_->evalmult_key_)
+    {
+        pc.set_evalmult_key(*computation_->evalmult_key_->serialized_);
+    }
 
     pc.set_timestamp(computation_->timestamp_);
+    pc.set_cse(computation_->cse_);
 
-    // since serialization uses the unbound ciphertexts, get from archive if current ones are bound
-    auto c_vec = (computation_->is_bound_) ? computation_->unbound_ciphertexts_archive_ : computation_->ciphertexts_;
-    for (const auto &c : c_vec)
+    for (const auto &c : computation_->ciphertext_bytes_)
     {
-        std::ostringstream oss;
-        Serial::Serialize(c, oss, SerType::BINARY);
-        auto oss_str = oss.str();
-        pc.add_ciphertexts()->assign(oss_str);
+        pc.add_ciphertexts()->assign(*c);
     }
 
     if (proof_.size() > 0)
     {
         pc.set_proof(std::string(proof_.begin(), proof_.end()));
+        pc.set_proof_backend(static_cast<uint32_t>(backend_));
+        pc.set_shape_id(std::string(proof_shape_id_.begin(), proof_shape_id_.end()));
     }
 
-    if (last_res_)
+    if (last_res_ && output_bytes_of_ == last_res_)
+    {
+        pc.set_output(*output_bytes_);
+    }
+    else if (last_res_)
     {
         std::ostringstream oss;
         Serial::Serialize(last_res_, oss, SerType::BINARY);
-        auto oss_str = oss.str();
-        pc.set_output(oss_str);
+        pc.set_output(oss.str());
     }
 
     return pc;
@@ -493,16 +837,21 @@ FHEComputer FHEComputer::from_proto(const ProtoComputation &proto)
     FHEComputer computer;
     computer.has_hash_ = false;
     computer.computation_ = std::make_shared<FHEComputation>(FHEComputation::from_proto(proto));
-    computer.ast_ = std::make_unique<ASTree>(computer.computation_->expression_);
+    computer.ast_ = std::make_unique<ASTree>(computer.computation_->expression_, computer.computation_->cse_);
+    computer.schedule_program();
     if (!proto.output().empty())
     {
         std::istringstream iss(proto.output());
         Serial::Deserialize(computer.last_res_, iss, SerType::BINARY);
+        computer.output_bytes_ = std::make_shared<const std::string>(proto.output());
+        computer.output_bytes_of_ = computer.last_res_;
     }
 
     if (!proto.proof().empty())
     {
         computer.proof_ = std::vector<unsigned char>(proto.proof().begin(), proto.proof().end());
     }
+    computer.backend_ = static_cast<ProofBackendType>(proto.proof_backend());
+    computer.proof_shape_id_ = std::vector<unsigned char>(proto.shape_id().begin(), proto.shape_id().end());
     return computer;
 }
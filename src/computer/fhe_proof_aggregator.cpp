@@ -0,0 +1,88 @@
+#include "computer/fhe_proof_aggregator.hpp"
+
+#include <chrono>
+#include <iostream>
+#include <iterator>
+#include <stdexcept>
+
+std::shared_ptr<FHEComputer> FHEProofAggregator::as_fhe(const std::shared_ptr<Computation> &comp)
+{
+    auto fhe = std::dynamic_pointer_cast<FHEComputer>(comp);
+    if (!fhe)
+    {
+        throw std::invalid_argument("Block proofs only support FHE computations.");
+    }
+    return fhe;
+}
+
+std::vector<unsigned char> FHEProofAggregator::prove(const std::vector<std::shared_ptr<Computation>> &computations)
+{
+    // circuits are held until the combined system is built
+    std::vector<std::shared_ptr<const R1CSCache::Circuit>> circuits;
+    std::vector<R1CSPart<FieldT>> parts;
+    libiop::r1cs_primary_input<FieldT> primary;
+    libiop::r1cs_auxiliary_input<FieldT> aux;
+    ComputationTimings total;
+
+    auto start = std::chrono::steady_clock::now();
+    for (const auto &comp : computations)
+    {
+        libiop::r1cs_primary_input<FieldT> comp_primary;
+        libiop::r1cs_auxiliary_input<FieldT> comp_aux;
+        auto fhe = as_fhe(comp);
+        auto circuit = fhe->prove_circuit(comp_primary, comp_aux);
+        total.bind_ms += fhe->timings_.bind_ms;
+        total.constraints_ms += fhe->timings_.constraints_ms;
+
+        primary.insert(primary.end(), std::make_move_iterator(comp_primary.begin()), std::make_move_iterator(comp_primary.end()));
+        aux.insert(aux.end(), std::make_move_iterator(comp_aux.begin()), std::make_move_iterator(comp_aux.end()));
+        parts.push_back({&circuit->cs_, circuit->num_constraints_, circuit->num_inputs_, circuit->kept_aux_.size()});
+        circuits.push_back(std::move(circuit));
+    }
+
+    libiop::r1cs_constraint_system<FieldT> cs;
+    concatenate_padded_r1cs_constraint_systems(parts, cs);
+    std::cout << "Block constraint system of " << computations.size() << " computations:" << std::endl;
+    std::cout << "#inputs:      " << cs.num_inputs() << std::endl;
+    std::cout << "#variables:   " << cs.num_variables() << std::endl;
+    std::cout << "#constraints: " << cs.num_constraints() << std::endl;
+
+    pad_primary_input_to_match_cs(cs, primary);
+    pad_auxiliary_input_to_match_cs(cs, aux);
+
+    // a single argument per block, so proof size matters more than for single computations
+    auto proof = ProofBackend::get(ProofBackendType::Aurora).prove({}, cs, primary, aux);
+
+    auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    total.prove_ms = elapsed - total.constraints_ms;
+    // a block proof counts as one
+    FHEComputer::record_timings(total);
+    return proof;
+}
+
+bool FHEProofAggregator::verify(const std::vector<std::shared_ptr<Computation>> &computations, const std::vector<unsigned char> &proof)
+{
+    std::vector<std::shared_ptr<const R1CSCache::Circuit>> circuits;
+    std::vector<R1CSPart<FieldT>> parts;
+    libiop::r1cs_primary_input<FieldT> primary;
+
+    for (const auto &comp : computations)
+    {
+        libiop::r1cs_primary_input<FieldT> comp_primary;
+        auto circuit = as_fhe(comp)->verify_circuit(comp_primary);
+        if (!circuit)
+        {
+            return false;
+        }
+
+        primary.insert(primary.end(), std::make_move_iterator(comp_primary.begin()), std::make_move_iterator(comp_primary.end()));
+        parts.push_back({&circuit->cs_, circuit->num_constraints_, circuit->num_inputs_, circuit->kept_aux_.size()});
+        circuits.push_back(std::move(circuit));
+    }
+
+    libiop::r1cs_constraint_system<FieldT> cs;
+    concatenate_padded_r1cs_constraint_systems(parts, cs);
+    pad_primary_input_to_match_cs(cs, primary);
+
+    return ProofBackend::get(ProofBackendType::Aurora).verify({}, cs, primary, proof);
+}
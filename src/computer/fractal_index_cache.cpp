@@ -0,0 +1,331 @@
+#include "computer/fractal_index_cache.hpp"
+
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <thread>
+#include <unistd.h>
+
+#include "sodium.h"
+
+FractalIndexCache::FractalIndexCache(std::size_t capacity) : capacity_(capacity)
+{
+}
+
+FractalIndexCache &FractalIndexCache::instance()
+{
+    static FractalIndexCache cache(16);
+    return cache;
+}
+
+void FractalIndexCache::set_directory(const std::string &dir)
+{
+    if (!dir.empty())
+    {
+        std::filesystem::create_directories(dir);
+    }
+    std::lock_guard<std::mutex> lg(mu_);
+    dir_ = dir;
+}
+
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::find(const std::string &key)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    auto it = lookup_.find(key);
+    if (it == lookup_.end())
+    {
+        return nullptr;
+    }
+    items_.splice(items_.begin(), items_, it->second);
+    return it->second->second;
+}
+
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::insert(const std::string &key, std::shared_ptr<const Entry> entry)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    auto it = lookup_.find(key);
+    if (it != lookup_.end())
+    {
+        // keep an entry that can also prove
+        if (!it->second->second->prover_index_ && entry->prover_index_)
+        {
+            it->second->second = std::move(entry);
+        }
+        items_.splice(items_.begin(), items_, it->second);
+        return it->second->second;
+    }
+
+    items_.emplace_front(key, std::move(entry));
+    lookup_[key] = items_.begin();
+    if (items_.size() > capacity_)
+    {
+        lookup_.erase(items_.back().first);
+        items_.pop_back();
+    }
+    return items_.front().second;
+}
+
+std::shared_ptr<const FractalIndexCache::Params> FractalIndexCache::make_params(std::shared_ptr<R1CSCache::ConstraintSystem> cs)
+{
+    auto set = AuroraParamSet::standard();
+    // the parameters keep the system for the indexer and the domain sizes
+    return std::make_shared<const Params>(
+        set.security_parameter,
+        set.ldt_reducer_soundness_type,
+        set.fri_soundness_type,
+        libiop::blake2b_type,
+        set.FRI_localization_parameter,
+        set.RS_extra_dimensions,
+        set.make_zk,
+        set.domain_type,
+        cs);
+}
+
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::index(const std::vector<unsigned char> &shape_id, std::shared_ptr<R1CSCache::ConstraintSystem> cs)
+{
+    std::cout << "Indexing circuit shape for Fractal..." << std::endl;
+    auto entry = std::make_shared<Entry>();
+    entry->cs_ = cs;
+    entry->params_ = make_params(std::move(cs));
+    auto indexes = libiop::fractal_snark_indexer<FieldT, hash_type>(*entry->params_);
+
+    entry->prover_index_ = std::make_shared<const ProverIndex>(std::move(indexes.first));
+    entry->verifier_index_ = std::make_shared<const VerifierIndex>(std::move(indexes.second));
+    store(shape_id, *entry);
+    return entry;
+}
+
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::for_prover(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs)
+{
+    std::string key(shape_id.begin(), shape_id.end());
+    auto entry = find(key);
+    if (entry && entry->prover_index_)
+    {
+        return entry;
+    }
+
+    // built without holding the lock, like the Aurora parameters
+    return insert(key, index(shape_id, std::make_shared<R1CSCache::ConstraintSystem>(cs)));
+}
+
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::for_verifier(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs)
+{
+    auto entry = find_verifier(shape_id);
+    if (entry)
+    {
+        return entry;
+    }
+
+    std::string key(shape_id.begin(), shape_id.end());
+    return insert(key, index(shape_id, std::make_shared<R1CSCache::ConstraintSystem>(cs)));
+}
+
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::find_verifier(const std::vector<unsigned char> &shape_id)
+{
+    std::string key(shape_id.begin(), shape_id.end());
+    auto entry = find(key);
+    if (entry)
+    {
+        return entry;
+    }
+
+    auto loaded = load(shape_id);
+    if (!loaded)
+    {
+        return nullptr;
+    }
+    return insert(key, std::move(loaded));
+}
+
+std::string FractalIndexCache::path(const std::vector<unsigned char> &shape_id, const std::string &ext)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    if (dir_.empty())
+    {
+        return "";
+    }
+
+    std::string hex(shape_id.size() * 2 + 1, '\0');
+    sodium_bin2hex(hex.data(), hex.size(), shape_id.data(), shape_id.size());
+    hex.pop_back();
+    return (std::filesystem::path(dir_) / (hex + ext)).string();
+}
+
+namespace
+{
+    template <typename FieldT>
+    void write_combination(std::ostream &os, const libiop::linear_combination<FieldT> &lc)
+    {
+        os << lc.terms.size() << '\n';
+        for (const auto &lt : lc.terms)
+        {
+            os << lt.index_ << '\n'
+               << lt.coeff_ << '\n';
+        }
+    }
+
+    template <typename FieldT>
+    void read_combination(std::istream &is, libiop::linear_combination<FieldT> &lc)
+    {
+        std::size_t terms = 0;
+        is >> terms;
+        lc.terms.resize(terms);
+        for (auto &lt : lc.terms)
+        {
+            is >> lt.index_ >> lt.coeff_;
+        }
+    }
+
+    // workers indexing the same shape at once each write their own file
+    std::string temp_path(const std::string &p)
+    {
+        std::ostringstream oss;
+        oss << p << '.' << getpid() << '.' << std::this_thread::get_id() << ".tmp";
+        return oss.str();
+    }
+
+    // the files are only a cache, so a failed write or rename is reported and the file left out
+    bool move_into_place(std::ofstream &ofs, const std::string &tmp, const std::string &p)
+    {
+        ofs.close();
+        std::error_code ec;
+        if (ofs)
+        {
+            std::filesystem::rename(tmp, p, ec);
+            if (!ec)
+            {
+                return true;
+            }
+        }
+        std::cout << "Could not write Fractal index " << p << std::endl;
+        std::filesystem::remove(tmp, ec);
+        return false;
+    }
+}
+
+// .vk:
+// - Root count, then each root as its size and bytes
+// - Message count, then each message as its size and field elements
+// .r1cs:
+// - Primary and auxiliary input sizes
+// - Constraint count, then each constraint as its three linear combinations, a term count and the terms
+std::shared_ptr<const FractalIndexCache::Entry> FractalIndexCache::load(const std::vector<unsigned char> &shape_id)
+{
+    auto p = path(shape_id, ".vk");
+    if (p.empty())
+    {
+        return nullptr;
+    }
+    std::ifstream ifs(p, std::ios::binary);
+    std::ifstream cs_ifs(path(shape_id, ".r1cs"), std::ios::binary);
+    if (!ifs || !cs_ifs)
+    {
+        return nullptr;
+    }
+
+    auto index = std::make_shared<VerifierIndex>();
+    std::size_t roots = 0;
+    ifs >> roots;
+    index->index_MT_roots_.resize(roots);
+    for (auto &root : index->index_MT_roots_)
+    {
+        std::size_t size = 0;
+        ifs >> size;
+        ifs.get();
+        root.resize(size);
+        ifs.read(root.data(), size);
+    }
+
+    std::size_t messages = 0;
+    ifs >> messages;
+    index->indexed_messages_.resize(messages);
+    for (auto &message : index->indexed_messages_)
+    {
+        std::size_t size = 0;
+        ifs >> size;
+        message.resize(size);
+        for (auto &el : message)
+        {
+            ifs >> el;
+        }
+    }
+
+    auto cs = std::make_shared<R1CSCache::ConstraintSystem>();
+    std::size_t constraints = 0;
+    cs_ifs >> cs->primary_input_size_ >> cs->auxiliary_input_size_ >> constraints;
+    cs->constraints_.resize(constraints);
+    for (auto &c : cs->constraints_)
+    {
+        read_combination(cs_ifs, c.a_);
+        read_combination(cs_ifs, c.b_);
+        read_combination(cs_ifs, c.c_);
+    }
+
+    if (!ifs || !cs_ifs)
+    {
+        std::cout << "Ignoring unreadable Fractal index " << p << std::endl;
+        return nullptr;
+    }
+    std::cout << "Loaded Fractal index " << p << std::endl;
+
+    auto entry = std::make_shared<Entry>();
+    entry->cs_ = cs;
+    // the loaded system is used as is, only the parameters are derived again
+    entry->params_ = make_params(std::move(cs));
+    entry->verifier_index_ = std::move(index);
+    return entry;
+}
+
+void FractalIndexCache::store(const std::vector<unsigned char> &shape_id, const Entry &entry)
+{
+    auto p = path(shape_id, ".vk");
+    if (p.empty())
+    {
+        return;
+    }
+    auto cs_p = path(shape_id, ".r1cs");
+
+    // written next to the final paths and renamed, so a crash never leaves a partial index behind. The
+    // system goes first, an index is only loaded along with it
+    {
+        auto tmp = temp_path(cs_p);
+        std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+        const auto &cs = *entry.cs_;
+        ofs << cs.primary_input_size_ << '\n'
+            << cs.auxiliary_input_size_ << '\n'
+            << cs.constraints_.size() << '\n';
+        for (const auto &c : cs.constraints_)
+        {
+            write_combination(ofs, c.a_);
+            write_combination(ofs, c.b_);
+            write_combination(ofs, c.c_);
+        }
+        if (!move_into_place(ofs, tmp, cs_p))
+        {
+            return;
+        }
+    }
+
+    const auto &index = *entry.verifier_index_;
+    auto tmp = temp_path(p);
+    std::ofstream ofs(tmp, std::ios::binary | std::ios::trunc);
+    ofs << index.index_MT_roots_.size() << '\n';
+    for (const auto &root : index.index_MT_roots_)
+    {
+        ofs << root.size() << '\n';
+        ofs.write(root.data(), root.size());
+        ofs << '\n';
+    }
+
+    ofs << index.indexed_messages_.size() << '\n';
+    for (const auto &message : index.indexed_messages_)
+    {
+        ofs << message.size() << '\n';
+        for (const auto &el : message)
+        {
+            ofs << el << '\n';
+        }
+    }
+    move_into_place(ofs, tmp, p);
+}
@@ -0,0 +1,201 @@
+#include "computer/proof_backend.hpp"
+
+#include <iostream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+
+#include "libiop/snark/ligero_snark.hpp"
+#include "computer/fractal_index_cache.hpp"
+
+namespace
+{
+    typedef libiop::ligero_snark_parameters<FieldT, hash_type> LigeroParams;
+
+    // same security and domain as the Aurora parameter set
+    LigeroParams ligero_params()
+    {
+        auto set = AuroraParamSet::standard();
+
+        LigeroParams params;
+        params.security_level_ = set.security_parameter;
+        params.LDT_reducer_soundness_type_ = set.ldt_reducer_soundness_type;
+        params.height_width_ratio_ = 0.1;
+        params.RS_extra_dimensions_ = set.RS_extra_dimensions;
+        params.make_zk_ = set.make_zk;
+        params.domain_type_ = set.domain_type;
+        params.bcs_hash_type_ = libiop::blake2b_type;
+        return params;
+    }
+
+    template <typename Argument>
+    std::vector<unsigned char> to_bytes(const Argument &argument)
+    {
+        std::ostringstream oss;
+        argument.serialize(oss);
+        auto st = oss.str();
+        return std::vector<unsigned char>(st.begin(), st.end());
+    }
+
+    template <typename Argument>
+    Argument from_bytes(const std::vector<unsigned char> &proof)
+    {
+        Argument argument;
+        std::string s(proof.begin(), proof.end());
+        std::istringstream iss(std::move(s));
+        argument.deserialize(iss);
+        return argument;
+    }
+}
+
+ProofBackend &ProofBackend::get(ProofBackendType type)
+{
+    static AuroraBackend aurora;
+    static LigeroBackend ligero;
+    static FractalBackend fractal;
+
+    switch (type)
+    {
+    case ProofBackendType::Aurora:
+        return aurora;
+    case ProofBackendType::Ligero:
+        return ligero;
+    case ProofBackendType::Fractal:
+        return fractal;
+    }
+    throw std::invalid_argument("Unknown proof backend.");
+}
+
+ProofBackendType ProofBackend::from_name(const std::string &name)
+{
+    if (name == "aurora")
+    {
+        return ProofBackendType::Aurora;
+    }
+    if (name == "ligero")
+    {
+        return ProofBackendType::Ligero;
+    }
+    if (name == "fractal")
+    {
+        return ProofBackendType::Fractal;
+    }
+    throw std::invalid_argument("Unknown proof backend: " + name);
+}
+
+std::string ProofBackend::name(ProofBackendType type)
+{
+    switch (type)
+    {
+    case ProofBackendType::Ligero:
+        return "ligero";
+    case ProofBackendType::Fractal:
+        return "fractal";
+    default:
+        return "aurora";
+    }
+}
+
+std::vector<unsigned char> AuroraBackend::prove(const std::vector<unsigned char> &, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                                const libiop::r1cs_auxiliary_input<FieldT> &aux)
+{
+    // domains only depend on the padded sizes, shared with every other proof of the same size
+    auto params = AuroraParamsCache::instance().get(AuroraParamSet::standard(), cs.num_constraints(), cs.num_variables());
+
+    const libiop::aurora_snark_argument<FieldT, hash_type> argument = aurora_snark_prover<FieldT>(cs, primary, aux, *params);
+
+    printf("iop size in bytes %lu\n", argument.IOP_size_in_bytes());
+    printf("bcs size in bytes %lu\n", argument.BCS_size_in_bytes());
+    printf("argument size in bytes %lu\n", argument.size_in_bytes());
+
+    return to_bytes(argument);
+}
+
+bool AuroraBackend::verify(const std::vector<unsigned char> &, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                   const std::vector<unsigned char> &proof)
+{
+    auto argument = from_bytes<libiop::aurora_snark_argument<FieldT, hash_type>>(proof);
+    auto params = AuroraParamsCache::instance().get(AuroraParamSet::standard(), cs.num_constraints(), cs.num_variables());
+    return aurora_snark_verifier<FieldT, hash_type>(cs, primary, argument, *params);
+}
+
+std::vector<unsigned char> LigeroBackend::prove(const std::vector<unsigned char> &, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                                const libiop::r1cs_auxiliary_input<FieldT> &aux)
+{
+    const libiop::ligero_snark_argument<FieldT, hash_type> argument = libiop::ligero_snark_prover<FieldT, hash_type>(cs, primary, aux, ligero_params());
+
+    printf("ligero argument size in bytes %lu\n", argument.size_in_bytes());
+
+    return to_bytes(argument);
+}
+
+bool LigeroBackend::verify(const std::vector<unsigned char> &, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                   const std::vector<unsigned char> &proof)
+{
+    auto argument = from_bytes<libiop::ligero_snark_argument<FieldT, hash_type>>(proof);
+    return libiop::ligero_snark_verifier<FieldT, hash_type>(cs, primary, argument, ligero_params());
+}
+
+std::vector<unsigned char> FractalBackend::prove(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                                                 const libiop::r1cs_auxiliary_input<FieldT> &aux)
+{
+    if (shape_id.empty())
+    {
+        throw std::invalid_argument("Fractal proofs need a circuit shape.");
+    }
+    auto entry = FractalIndexCache::instance().for_prover(shape_id, cs);
+
+    const libiop::fractal_snark_argument<FieldT, hash_type> argument =
+        libiop::fractal_snark_prover<FieldT, hash_type>(*entry->prover_index_, primary, aux, *entry->params_);
+
+    printf("fractal argument size in bytes %lu\n", argument.size_in_bytes());
+
+    return to_bytes(argument);
+}
+
+bool FractalBackend::verify(const std::vector<unsigned char> &shape_id, const R1CSCache::ConstraintSystem &cs, const libiop::r1cs_primary_input<FieldT> &primary,
+                            const std::vector<unsigned char> &proof)
+{
+    if (shape_id.empty())
+    {
+        return false;
+    }
+    // only the first proof of a shape reads cs, later ones use the index
+    auto entry = FractalIndexCache::instance().for_verifier(shape_id, cs);
+
+    auto argument = from_bytes<libiop::fractal_snark_argument<FieldT, hash_type>>(proof);
+    return libiop::fractal_snark_verifier<FieldT, hash_type>(*entry->verifier_index_, primary, argument, *entry->params_);
+}
+
+ProofBackendPolicy &ProofBackendPolicy::instance()
+{
+    static ProofBackendPolicy policy;
+    return policy;
+}
+
+void ProofBackendPolicy::configure(const json &bands)
+{
+    std::vector<std::pair<std::size_t, ProofBackendType>> parsed;
+    for (const auto &band : bands)
+    {
+        std::size_t max_constraints = band.value("max_constraints", std::numeric_limits<std::size_t>::max());
+        parsed.emplace_back(max_constraints, ProofBackend::from_name(band.at("backend")));
+        std::cout << "Proofs up to " << max_constraints << " constraints use " << ProofBackend::name(parsed.back().second) << std::endl;
+    }
+
+    std::lock_guard<std::mutex> lg(mu_);
+    bands_ = std::move(parsed);
+}
+
+ProofBackendType ProofBackendPolicy::select(std::size_t num_constraints)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    for (const auto &band : bands_)
+    {
+        if (num_constraints <= band.first)
+        {
+            return band.second;
+        }
+    }
+    return ProofBackendType::Aurora;
+}
@@ -0,0 +1,102 @@
+#include "computer/public_key_cache.hpp"
+
+#include <sstream>
+#include "sodium.h"
+
+PublicKeyCache::PublicKeyCache(std::size_t capacity_bytes) : capacity_bytes_(capacity_bytes), bytes_(0)
+{
+}
+
+PublicKeyCache &PublicKeyCache::instance()
+{
+    static PublicKeyCache cache(256 << 20);
+    return cache;
+}
+
+std::vector<unsigned char> PublicKeyCache::digest(const std::string &serialized)
+{
+    std::vector<unsigned char> res(crypto_generichash_BYTES);
+    crypto_generichash(res.data(), res.size(), reinterpret_cast<const unsigned char *>(serialized.data()), serialized.size(), nullptr, 0);
+    return res;
+}
+
+std::size_t PublicKeyCache::key_bytes(const PublicKey<DCRTPoly> &key)
+{
+    // one 64-bit native integer per coefficient of every RNS tower
+    std::size_t bytes = 0;
+    for (const auto &element : key->GetPublicElements())
+    {
+        bytes += element.GetNumOfElements() * element.GetRingDimension() * sizeof(uint64_t);
+    }
+    return bytes;
+}
+
+std::shared_ptr<const PublicKeyCache::Entry> PublicKeyCache::get(const std::string &serialized)
+{
+    auto d = digest(serialized);
+    std::string k(d.begin(), d.end());
+
+    {
+        std::lock_guard<std::mutex> lg(mu_);
+        auto it = index_.find(k);
+        if (it != index_.end())
+        {
+            entries_.splice(entries_.begin(), entries_, it->second);
+            return it->second->second;
+        }
+    }
+
+    // deserialized without holding the lock, as in AuroraParamsCache
+    auto entry = std::make_shared<Entry>();
+    std::istringstream iss(serialized);
+    Serial::Deserialize(entry->key_, iss, SerType::BINARY);
+    entry->serialized_ = std::make_shared<const std::string>(serialized);
+    entry->digest_ = std::move(d);
+    // the serialization and the key
+    entry->bytes_ = serialized.size() + key_bytes(entry->key_);
+
+    std::lock_guard<std::mutex> lg(mu_);
+    auto it = index_.find(k);
+    if (it != index_.end())
+    {
+        // another computation with the same key got here first
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return it->second->second;
+    }
+
+    entries_.emplace_front(k, entry);
+    index_[k] = entries_.begin();
+    bytes_ += entry->bytes_;
+    evict();
+    return entry;
+}
+
+void PublicKeyCache::set_capacity(std::size_t capacity_bytes)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    capacity_bytes_ = capacity_bytes;
+    evict();
+}
+
+void PublicKeyCache::evict()
+{
+    // the most recent entry is always kept, computations holding evicted keys keep them alive
+    while (bytes_ > capacity_bytes_ && entries_.size() > 1)
+    {
+        bytes_ -= entries_.back().second->bytes_;
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+}
+
+std::size_t PublicKeyCache::size()
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    return entries_.size();
+}
+
+std::size_t PublicKeyCache::bytes()
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    return bytes_;
+}
@@ -0,0 +1,53 @@
+#include "computer/r1cs_cache.hpp"
+
+R1CSCache::R1CSCache(std::size_t capacity) : capacity_(capacity)
+{
+}
+
+R1CSCache &R1CSCache::instance()
+{
+    static R1CSCache cache(32);
+    return cache;
+}
+
+std::shared_ptr<const R1CSCache::Circuit> R1CSCache::get(const std::vector<unsigned char> &key)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    auto it = index_.find(std::string(key.begin(), key.end()));
+    if (it == index_.end())
+    {
+        return nullptr;
+    }
+
+    entries_.splice(entries_.begin(), entries_, it->second);
+    return it->second->second;
+}
+
+void R1CSCache::put(const std::vector<unsigned char> &key, std::shared_ptr<const Circuit> circuit)
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    std::string k(key.begin(), key.end());
+
+    auto it = index_.find(k);
+    if (it != index_.end())
+    {
+        // another computation with the same shape got here first, both are identical
+        entries_.splice(entries_.begin(), entries_, it->second);
+        return;
+    }
+
+    entries_.emplace_front(k, std::move(circuit));
+    index_[k] = entries_.begin();
+
+    if (entries_.size() > capacity_)
+    {
+        index_.erase(entries_.back().first);
+        entries_.pop_back();
+    }
+}
+
+std::size_t R1CSCache::size()
+{
+    std::lock_guard<std::mutex> lg(mu_);
+    return entries_.size();
+}
@@ -1,6 +1,7 @@
 #include "core/block_header.hpp"
 
 #include "util/util.hpp"
+#include "util/byte_sink.hpp"
 
 #include "sodium.h"
 
@@ -16,12 +17,13 @@ BlockHeader::BlockHeader(const std::vector<unsigned char> &prev_hash, const std:
 {
 }
 
-std::vector<unsigned char> BlockHeader::serialize(bool include_proofs)
+void BlockHeader::serialize_to(util::ByteSink &sink, bool include_proofs)
 {
     // - Previous block hash
     // - Merkle root (should also contain the "coinbase" transactions)
     // - Timestamp
     // - Difficulty (in my case, minimum depth)
+    // - Binding version (4 bytes), if not BINDING_FULL_HEADER
     // - Computation count (8 bytes)
     // - For each computation
     // 	- Computation size
@@ -29,39 +31,55 @@ std::vector<unsigned char> BlockHeader::serialize(bool include_proofs)
     // - For each computation
     // 	- Proof size
     // 	- Proof
-
-    std::vector<unsigned char> res = prev_hash();
-
-    res.insert(res.end(), merkle_root_.begin(), merkle_root_.end());
-    auto t = util::uint64_to_vector_big_endian(timestamp_);
-    res.insert(res.end(), t.begin(), t.end());
-    auto d = util::uint32_to_vector_big_endian(difficulty_);
-    res.insert(res.end(), d.begin(), d.end());
-    auto count = util::uint64_to_vector_big_endian(computations_.size());
-    res.insert(res.end(), count.begin(), count.end());
+    // or, for a block proof
+    // - Block proof tag (8 bytes)
+    // - Block proof size
+    // - Block proof
+
+    sink.write(prev_hash());
+    sink.write(merkle_root_);
+    sink.write_uint64(timestamp_);
+    sink.write_uint32(difficulty_);
+    // only present when not the default, so headers binding the full header serialize as before
+    if (binding_version_ != BINDING_FULL_HEADER)
+    {
+        sink.write_uint32(binding_version_);
+    }
+    sink.write_uint64(computations_.size());
     for (const auto &comp : computations_)
     {
         // include_proofs being false means we are serializing to get binding data
         // which means we also don't want the serialized computation to include the output
-        auto cser = comp->serialize(include_proofs);
-        auto csize = util::uint64_to_vector_big_endian(cser.size());
-
-        res.insert(res.end(), csize.begin(), csize.end());
-        res.insert(res.end(), cser.begin(), cser.end());
+        sink.write_uint64(comp->serialized_size(include_proofs));
+        comp->serialize_to(sink, include_proofs);
     }
 
     // this allows serialization to produce binding data, since we don't want to include
     // proofs in that case
-    if (include_proofs)
+    if (include_proofs && !block_proof_.empty())
+    {
+        // tagged, so a block proof never serializes like the proof of a computation
+        sink.write_uint64(BLOCK_PROOF_TAG);
+        sink.write_sized(block_proof_);
+    }
+    else if (include_proofs)
     {
         for (const auto &comp : computations_)
         {
-            auto pser = comp->proof();
-            auto psize = util::uint64_to_vector_big_endian(pser.size());
-            res.insert(res.end(), psize.begin(), psize.end());
-            res.insert(res.end(), pser.begin(), pser.end());
+            sink.write_sized(comp->proof());
         }
     }
+}
+
+std::vector<unsigned char> BlockHeader::serialize(bool include_proofs)
+{
+    util::SizeSink size;
+    serialize_to(size, include_proofs);
+
+    std::vector<unsigned char> res;
+    res.reserve(size.size());
+    util::VectorSink sink(res);
+    serialize_to(sink, include_proofs);
     return res;
 }
 
@@ -72,15 +90,26 @@ std::vector<unsigned char> BlockHeader::hash(bool force)
         return hash_;
     }
 
-    auto ser = serialize();
-
-    hash_.resize(crypto_generichash_BYTES);
-    crypto_generichash(hash_.data(), crypto_generichash_BYTES, ser.data(), ser.size(), nullptr, 0);
+    // a single pass over the header, the computations write their buffers straight into the hash
+    util::HashSink sink;
+    serialize_to(sink);
+    hash_ = sink.digest();
     has_hash_ = true;
 
     return hash_;
 }
 
+std::vector<unsigned char> BlockHeader::binding_prefix()
+{
+    if (binding_version_ == BINDING_HEADER_DIGEST)
+    {
+        util::HashSink sink;
+        serialize_to(sink, false);
+        return sink.digest();
+    }
+    return serialize(false);
+}
+
 std::vector<unsigned char> BlockHeader::prev_hash()
 {
     if (prev_block_header_)
@@ -117,6 +146,12 @@ ProtoBlockHeader BlockHeader::to_proto() const
         pbh.add_computations()->CopyFrom(comp->to_proto());
     }
 
+    if (!block_proof_.empty())
+    {
+        pbh.set_block_proof(std::string(block_proof_.begin(), block_proof_.end()));
+    }
+    pbh.set_binding_version(binding_version_);
+
     return pbh;
 }
 
@@ -127,6 +162,8 @@ message ProtoBlockHeader {
     int64 timestamp = 3;
     uint32 difficulty = 4;
     repeated ProtoComputation computations = 5;
+    bytes block_proof = 6;
+    uint32 binding_version = 7;
 }
 */
 
@@ -147,6 +184,9 @@ BlockHeader BlockHeader::from_proto(const ProtoBlockHeader &proto, const Computa
         bh.computations_.push_back(comp_factory.createComputation(proto_comp));
     }
 
+    bh.block_proof_ = std::vector<unsigned char>(proto.block_proof().begin(), proto.block_proof().end());
+    bh.binding_version_ = proto.binding_version();
+
     std::cout << "Inside header from_proto, prev_hash: " << base64::encode(bh.prev_hash_.data(), bh.prev_hash_.size()) << std::endl;
 
     return bh;
@@ -31,9 +31,8 @@ int main()
 
     computer.bind_to_data(seed);
     auto result = computer.evaluate();
-    computer.generate_constraints();
-    auto arg = computer.generate_argument();
-    std::cout << "Valid?: " << computer.verify_argument(arg) << std::endl;
+    computer.generate_proof();
+    std::cout << "Valid?: " << computer.verify_proof(computer.proof()) << std::endl;
     // computer.generate_witness();
 
     // load key
@@ -42,6 +42,20 @@ json RPCRouter::route(const json &json_msg)
 
         break;
     }
+    case RPCType::Metrics:
+    {
+        std::cout << "Got Metrics RPC" << std::endl;
+        node_.rpc_handle_metrics(json_msg, resp);
+
+        break;
+    }
+    case RPCType::Estimate:
+    {
+        std::cout << "Got Estimate RPC" << std::endl;
+        node_.rpc_handle_estimate(json_msg, resp);
+
+        break;
+    }
 
     default:
         throw std::invalid_argument("Unknown RPC type.");
@@ -9,11 +9,20 @@
 #include <asio/write.hpp>
 
 #include "util/util.hpp"
+#include "util/thread_pool.hpp"
 
 #include "msg/message.hpp"
 #include "message.pb.h"
 
 #include "computer/concrete_computation_factory.hpp"
+#include "computer/aurora_params_cache.hpp"
+#include "computer/fhe_proof_aggregator.hpp"
+#include "computer/proof_backend.hpp"
+#include "computer/fractal_index_cache.hpp"
+#include "computer/public_key_cache.hpp"
+#include "computer/eval_key_registry.hpp"
+#include "computer/r1cs_cache.hpp"
+#include "computer/cost_model.hpp"
 
 using asio::awaitable;
 using asio::co_spawn;
@@ -43,7 +52,17 @@ Node::Node(json &config, asio::io_context &io_context, std::shared_ptr<IChainsta
     }
     chain_manager_ = std::make_unique<ChainManager>(config, cs,
                                                     bs, mp,
-                                                    compstore, stop_flag_, wallet_);
+                                                    compstore, stop_flag_, wallet_,
+                                                    std::make_shared<FHEProofAggregator>());
+    if (config.contains("proof"))
+    {
+        aurora_warmup_ = config["proof"].value("aurora_warmup", json::array());
+        FractalIndexCache::instance().set_directory(config["proof"].value("fractal_index_dir", ""));
+        PublicKeyCache::instance().set_capacity(config["proof"].value("public_key_cache_mb", std::size_t(256)) << 20);
+        CostModel::instance().configure(config["proof"].value("cost_model", json::object()));
+        ThreadPool::set_validation_threads(config["proof"].value("validation_workers", std::size_t(0)));
+    }
+    ProofBackendPolicy::instance().configure(config.at("chain").value("proof_backends", json::array()));
     bootstrap_from_config(config);
 }
 
@@ -51,6 +70,17 @@ void Node::start()
 {
     std::cout << "starting node" << std::endl;
 
+    // Aurora parameters for the configured sizes are built while connecting and syncing, so the first block
+    // does not pay for them
+    std::thread warmup_thread([this]()
+                              {
+                                try
+                                {
+                                    AuroraParamsCache::instance().warm_up(aurora_warmup_);
+                                } catch(std::exception& exc){
+                                    std::cerr << "Aurora warm-up failed: " << exc.what() << std::endl;
+                                } });
+
     std::thread io_thread([this]()
                           {
                             try
@@ -76,6 +106,7 @@ void Node::start()
     sync_cv_.wait(lock, [this]
                   { return this->is_synced_; });
     lock.unlock();
+    warmup_thread.join();
 
     for (;;)
     {
@@ -852,4 +883,35 @@ void Node::rpc_handle_output(const json &req, json &resp)
     {
         resp["status"] = STATUS_INTERNAL_SERVER_ERROR;
     }
-}
\ No newline at end of file
+}
+
+void Node::rpc_handle_metrics(const json &, json &resp)
+{
+    auto &keys = PublicKeyCache::instance();
+
+    resp["status"] = STATUS_OK;
+    resp["eval_keys"] = EvalKeyRegistry::instance().metrics();
+    resp["public_keys"] = {{"entries", keys.size()}, {"bytes", keys.bytes()}};
+    resp["r1cs_cache"] = {{"entries", R1CSCache::instance().size()}};
+    resp["cost_model"] = CostModel::instance().config();
+    resp["proof_timings"] = FHEComputer::timing_totals();
+}
+
+void Node::rpc_handle_estimate(const json &req, json &resp)
+{
+    std::shared_ptr<Computation> comp;
+    try
+    {
+        comp = std::make_shared<FHEComputer>(req);
+    }
+    catch (const std::exception &e)
+    {
+        resp["status"] = STATUS_INTERNAL_SERVER_ERROR;
+        std::cerr << e.what() << '\n';
+        return;
+    }
+
+    resp["status"] = STATUS_OK;
+    resp["difficulty"] = comp->difficulty();
+    resp["cost"] = CostModel::to_json(comp->estimate_cost());
+}
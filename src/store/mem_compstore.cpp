@@ -1,4 +1,5 @@
 #include "store/mem_compstore.hpp"
+#include <algorithm>
 #include <iostream>
 
 bool MemCompStore::store_computation(std::shared_ptr<Computation> comp)
@@ -50,16 +51,39 @@ std::vector<std::shared_ptr<Computation>> MemCompStore::collect_computations(uin
 {
     std::cout << "running collect" << std::endl;
     std::lock_guard<std::mutex> lg(mu_);
+
+    // every computation is still picked until the target is reached, only the order changes: cheapest depth
+    // first, by predicted prove time per unit of difficulty. Computations without depth are served first,
+    // quickest first, since they would never be reached otherwise
+    std::vector<std::pair<double, std::shared_ptr<Computation>>> candidates;
+    candidates.reserve(storage_.size());
+    for (const auto &pair : storage_)
+    {
+        auto diff = pair.second->difficulty();
+        auto prove_s = pair.second->estimate_cost().prove_s;
+        candidates.emplace_back((diff > 0) ? prove_s / diff : prove_s, pair.second);
+    }
+    std::stable_sort(candidates.begin(), candidates.end(), [](const auto &a, const auto &b)
+                     {
+                         bool a_free = a.second->difficulty() == 0, b_free = b.second->difficulty() == 0;
+                         if (a_free != b_free)
+                         {
+                             return a_free;
+                         }
+                         return a.first < b.first; });
+
     std::vector<std::shared_ptr<Computation>> res;
     uint32_t total = 0;
-    for (const auto &pair : storage_)
+    double prove_s = 0;
+    for (const auto &[cost, comp] : candidates)
     {
-        // naive pick, could optimize for size/difficulty
-        res.push_back(pair.second);
-        total += pair.second->difficulty();
+        res.push_back(comp);
+        total += comp->difficulty();
+        prove_s += (comp->difficulty() > 0) ? cost * comp->difficulty() : cost;
         if (total >= target)
         {
             // reached target difficulty
+            std::cout << "collected " << res.size() << " computations, predicted proving time " << prove_s << " s" << std::endl;
             return res;
         }
     }
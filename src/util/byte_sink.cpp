@@ -0,0 +1,75 @@
+#include "util/byte_sink.hpp"
+
+#include "util/util.hpp"
+
+void util::ByteSink::write(const std::vector<unsigned char> &bytes)
+{
+    write(bytes.data(), bytes.size());
+}
+
+void util::ByteSink::write(const std::string &bytes)
+{
+    write(reinterpret_cast<const unsigned char *>(bytes.data()), bytes.size());
+}
+
+void util::ByteSink::write_uint32(uint32_t num)
+{
+    unsigned char buf[4];
+    uint32_to_uchar_big_endian(num, buf);
+    write(buf, sizeof(buf));
+}
+
+void util::ByteSink::write_uint64(uint64_t num)
+{
+    unsigned char buf[8];
+    uint64_to_uchar_big_endian(num, buf);
+    write(buf, sizeof(buf));
+}
+
+void util::ByteSink::write_sized(const std::vector<unsigned char> &bytes)
+{
+    write_uint64(bytes.size());
+    write(bytes);
+}
+
+void util::ByteSink::write_sized(const std::string &bytes)
+{
+    write_uint64(bytes.size());
+    write(bytes);
+}
+
+util::VectorSink::VectorSink(std::vector<unsigned char> &out) : out_(out)
+{
+}
+
+void util::VectorSink::write(const unsigned char *data, std::size_t size)
+{
+    out_.insert(out_.end(), data, data + size);
+}
+
+void util::SizeSink::write(const unsigned char *, std::size_t size)
+{
+    size_ += size;
+}
+
+std::size_t util::SizeSink::size() const
+{
+    return size_;
+}
+
+util::HashSink::HashSink()
+{
+    crypto_generichash_init(&state_, nullptr, 0, crypto_generichash_BYTES);
+}
+
+void util::HashSink::write(const unsigned char *data, std::size_t size)
+{
+    crypto_generichash_update(&state_, data, size);
+}
+
+std::vector<unsigned char> util::HashSink::digest()
+{
+    std::vector<unsigned char> res(crypto_generichash_BYTES);
+    crypto_generichash_final(&state_, res.data(), res.size());
+    return res;
+}
@@ -0,0 +1,229 @@
+#include "util/thread_pool.hpp"
+
+#include <chrono>
+
+namespace
+{
+    // identifies the pool and deque owned by the current thread, if it is a worker
+    thread_local ThreadPool *tl_pool = nullptr;
+    thread_local std::size_t tl_queue_idx = 0;
+
+    std::atomic<std::size_t> validation_threads(0);
+}
+
+ThreadPool::ThreadPool(std::size_t threads) : stop_(false), pending_(0), next_queue_(0)
+{
+    if (threads == 0)
+    {
+        threads = 1;
+    }
+
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        queues_.push_back(std::make_unique<WorkQueue>());
+    }
+
+    for (std::size_t i = 0; i < threads; ++i)
+    {
+        workers_.emplace_back([this, i]()
+                              { worker_loop(i); });
+    }
+}
+
+ThreadPool::~ThreadPool()
+{
+    {
+        std::lock_guard<std::mutex> lg(sleep_mu_);
+        stop_ = true;
+    }
+    sleep_cv_.notify_all();
+
+    for (auto &w : workers_)
+    {
+        w.join();
+    }
+}
+
+std::size_t ThreadPool::size() const
+{
+    return workers_.size();
+}
+
+ThreadPool &ThreadPool::compute()
+{
+    static ThreadPool pool(std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+ThreadPool &ThreadPool::validation()
+{
+    static ThreadPool pool((validation_threads > 0) ? validation_threads.load() : std::max(1u, std::thread::hardware_concurrency()));
+    return pool;
+}
+
+void ThreadPool::set_validation_threads(std::size_t threads)
+{
+    validation_threads = threads;
+}
+
+void ThreadPool::submit(std::function<void()> task)
+{
+    // workers keep their own tasks local, everything else is spread over the deques
+    std::size_t idx = (tl_pool == this) ? tl_queue_idx : next_queue_++ % queues_.size();
+    {
+        std::lock_guard<std::mutex> lg(queues_[idx]->mu);
+        queues_[idx]->tasks.push_back(std::move(task));
+    }
+
+    {
+        // taking the lock orders the increment with a worker checking the predicate before sleeping
+        std::lock_guard<std::mutex> lg(sleep_mu_);
+        ++pending_;
+    }
+    sleep_cv_.notify_one();
+}
+
+bool ThreadPool::pop_task(std::size_t idx, std::function<void()> &task)
+{
+    // own deque first, newest task first
+    {
+        std::lock_guard<std::mutex> lg(queues_[idx]->mu);
+        if (!queues_[idx]->tasks.empty())
+        {
+            task = std::move(queues_[idx]->tasks.back());
+            queues_[idx]->tasks.pop_back();
+            --pending_;
+            return true;
+        }
+    }
+
+    // steal the oldest task of another deque
+    for (std::size_t i = 1; i < queues_.size(); ++i)
+    {
+        auto &victim = queues_[(idx + i) % queues_.size()];
+        std::lock_guard<std::mutex> lg(victim->mu);
+        if (!victim->tasks.empty())
+        {
+            task = std::move(victim->tasks.front());
+            victim->tasks.pop_front();
+            --pending_;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ThreadPool::try_run_one()
+{
+    std::function<void()> task;
+    std::size_t idx = (tl_pool == this) ? tl_queue_idx : next_queue_++ % queues_.size();
+    if (!pop_task(idx, task))
+    {
+        return false;
+    }
+    task();
+    return true;
+}
+
+void ThreadPool::worker_loop(std::size_t idx)
+{
+    tl_pool = this;
+    tl_queue_idx = idx;
+
+    for (;;)
+    {
+        std::function<void()> task;
+        if (pop_task(idx, task))
+        {
+            task();
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(sleep_mu_);
+        sleep_cv_.wait(lock, [this]
+                       { return stop_ || pending_ > 0; });
+        if (stop_)
+        {
+            return;
+        }
+    }
+}
+
+TaskGroup::TaskGroup(ThreadPool &pool) : pool_(pool), outstanding_(0), cancelled_(false)
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    // tasks reference the group, so it cannot go away before they are done
+    try
+    {
+        wait();
+    }
+    catch (...)
+    {
+    }
+}
+
+void TaskGroup::run(std::function<void()> task)
+{
+    ++outstanding_;
+    pool_.submit([this, task = std::move(task)]()
+                 {
+                     if (!cancelled_)
+                     {
+                         try
+                         {
+                             task();
+                         }
+                         catch (...)
+                         {
+                             std::lock_guard<std::mutex> lg(mu_);
+                             if (!error_)
+                             {
+                                 error_ = std::current_exception();
+                             }
+                             cancelled_ = true;
+                         }
+                     }
+
+                     std::lock_guard<std::mutex> lg(mu_);
+                     if (--outstanding_ == 0)
+                     {
+                         done_cv_.notify_all();
+                     } });
+}
+
+void TaskGroup::wait()
+{
+    while (outstanding_ > 0)
+    {
+        // help with pending work instead of blocking, this is what makes nested groups safe
+        if (pool_.try_run_one())
+        {
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lock(mu_);
+        done_cv_.wait_for(lock, std::chrono::milliseconds(1), [this]
+                          { return outstanding_ == 0; });
+    }
+
+    std::lock_guard<std::mutex> lg(mu_);
+    if (error_)
+    {
+        auto err = error_;
+        error_ = nullptr;
+        std::rethrow_exception(err);
+    }
+}
+
+void TaskGroup::cancel()
+{
+    cancelled_ = true;
+}
+
+bool TaskGroup::is_cancelled() const
+{
+    return cancelled_;
+}